@@ -0,0 +1,184 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <sys/param.h>
+#include "audio_render.h"
+#include "file.h"
+#include "mixer.h"
+#include "systemstub.h"
+#include "util.h"
+
+static const uint32_t TAG_RIFF = 0x46464952;
+static const uint32_t TAG_WAVE = 0x45564157;
+static const uint32_t TAG_fmt  = 0x20746D66;
+static const uint32_t TAG_data = 0x61746164;
+
+// audio only stub, the mixer callback is driven by renderAudio instead of a sound device
+struct SystemStub_Render : SystemStub {
+	AudioCallback _audioCbProc;
+	void *_audioCbData;
+	int _sampleRate;
+	int _bufferSize;
+
+	SystemStub_Render(int sampleRate, int bufferSize)
+		: _audioCbProc(0), _audioCbData(0), _sampleRate(sampleRate), _bufferSize(bufferSize) {
+		memset(&_pi, 0, sizeof(_pi));
+	}
+
+	virtual void init(const char *title, int w, int h, bool fullscreen, int widescreenMode, bool maximized, const ScalerParameters *scalerParameters, const AudioParameters *audioParameters) {}
+	virtual void destroy() {}
+
+	virtual bool hasWidescreen() const { return false; }
+	virtual void setScreenSize(int w, int h) {}
+	virtual void setPalette(const uint8_t *pal, int n) {}
+	virtual void getPalette(uint8_t *pal, int n) { memset(pal, 0, n * 3); }
+	virtual void setPaletteEntry(int i, const Color *c) {}
+	virtual void getPaletteEntry(int i, Color *c) { memset(c, 0, sizeof(Color)); }
+	virtual void setOverscanColor(int i) {}
+	virtual void copyRect(int x, int y, int w, int h, const uint8_t *buf, int pitch) {}
+	virtual void copyRectRgb24(int x, int y, int w, int h, const uint8_t *rgb) {}
+	virtual void zoomRect(int x, int y, int h, int w) {}
+	virtual void copyWidescreenLeft(int w, int h, const uint8_t *buf) {}
+	virtual void copyWidescreenRight(int w, int h, const uint8_t *buf) {}
+	virtual void copyWidescreenMirror(int w, int h, const uint8_t *buf) {}
+	virtual void copyWidescreenBlur(int w, int h, const uint8_t *buf) {}
+	virtual void copyWidescreenCDi(int w, int h, const uint8_t *buf, const uint8_t *pal) {}
+	virtual void clearWidescreen() {}
+	virtual void enableWidescreen(bool enable) {}
+	virtual void fadeScreen() {}
+	virtual void updateScreen(int shakeOffset) {}
+
+	virtual void processEvents() {}
+	virtual void sleep(int duration) {}
+	virtual uint32_t getTimeStamp() { return (uint32_t)(AudioStats::getTimeUs() / 1000); }
+
+	virtual void startAudio(AudioCallback callback, void *param) {
+		_audioCbProc = callback;
+		_audioCbData = param;
+	}
+	virtual void stopAudio() {
+		_audioCbProc = 0;
+		_audioCbData = 0;
+	}
+	virtual uint32_t getOutputSampleRate() { return _sampleRate; }
+	virtual uint32_t getOutputBufferSize() { return _bufferSize; }
+	// the callback runs on the calling thread
+	virtual void lockAudio() {}
+	virtual void unlockAudio() {}
+
+	void mix(int16_t *buf, int len) {
+		memset(buf, 0, len * 2 * sizeof(int16_t));
+		if (_audioCbProc) {
+			const uint64_t timeStamp = AudioStats::getTimeUs();
+			_audioCbProc(_audioCbData, buf, len);
+			_audioStats.addCallback((uint32_t)(AudioStats::getTimeUs() - timeStamp));
+		}
+	}
+};
+
+static void writeWavHeader(File &f, int sampleRate, uint32_t samplesCount) {
+	const uint32_t dataSize = samplesCount * 2 * sizeof(int16_t);
+	f.writeUint32LE(TAG_RIFF);
+	f.writeUint32LE(4 + 8 + 16 + 8 + dataSize);
+	f.writeUint32LE(TAG_WAVE);
+	f.writeUint32LE(TAG_fmt);
+	f.writeUint32LE(16);
+	f.writeUint16LE(1); // PCM
+	f.writeUint16LE(2); // channels
+	f.writeUint32LE(sampleRate);
+	f.writeUint32LE(sampleRate * 2 * sizeof(int16_t)); // bytes per second
+	f.writeUint16LE(2 * sizeof(int16_t)); // block align
+	f.writeUint16LE(16); // bits per sample
+	f.writeUint32LE(TAG_data);
+	f.writeUint32LE(dataSize);
+}
+
+// File::open prefixes the file name with the directory, split the path so that absolute paths are kept
+static bool openOutputFile(File &f, const char *path) {
+	const char *sep = strrchr(path, '/');
+#ifdef _WIN32
+	const char *backslash = strrchr(path, '\\');
+	if (backslash && (!sep || backslash > sep)) {
+		sep = backslash;
+	}
+#endif
+	if (!sep) {
+		return f.open(path, "wb", ".");
+	}
+	char directory[MAXPATHLEN];
+	const int len = MIN((int)(sep - path), (int)sizeof(directory) - 1);
+	if (len == 0) {
+		strcpy(directory, "/");
+	} else {
+		memcpy(directory, path, len);
+		directory[len] = 0;
+	}
+	return f.open(sep + 1, "wb", directory);
+}
+
+bool renderAudio(FileSystem *fs, ResourceType version, int midiDriver, const AudioParameters *audioParameters, const AudioRenderParameters *renderParameters) {
+	SystemStub_Render stub(audioParameters->sampleRate, audioParameters->bufferSize);
+	Mixer *mix = new Mixer(fs, &stub, midiDriver);
+	mix->init();
+	mix->_mod._isAmiga = (version == kResourceTypeAmiga);
+	stub._audioStats.reset(audioParameters->bufferSize, audioParameters->sampleRate);
+	mix->playMusic(renderParameters->music);
+	// the output file is only created once the music plays
+	if (mix->_musicType == Mixer::MT_NONE) {
+		warning("Unable to play music %d", renderParameters->music);
+		mix->free();
+		delete mix;
+		return false;
+	}
+	File f;
+	if (!openOutputFile(f, renderParameters->filename)) {
+		warning("Failed to open '%s' for writing", renderParameters->filename);
+		mix->stopMusic();
+		mix->free();
+		delete mix;
+		return false;
+	}
+	const uint32_t samplesCount = renderParameters->duration * audioParameters->sampleRate;
+	writeWavHeader(f, audioParameters->sampleRate, samplesCount);
+	int16_t *buf = (int16_t *)malloc(audioParameters->bufferSize * 2 * sizeof(int16_t));
+	uint8_t *data = (uint8_t *)malloc(audioParameters->bufferSize * 2 * sizeof(int16_t));
+	if (!buf || !data) {
+		error("Unable to allocate %d samples for audio rendering", audioParameters->bufferSize);
+	}
+	const uint64_t timeStamp = AudioStats::getTimeUs();
+	uint64_t mixDuration = 0;
+	for (uint32_t pos = 0; pos < samplesCount; ) {
+		const int count = MIN(samplesCount - pos, (uint32_t)audioParameters->bufferSize);
+		const uint64_t mixTimeStamp = AudioStats::getTimeUs();
+		stub.mix(buf, count);
+		mixDuration += AudioStats::getTimeUs() - mixTimeStamp;
+		for (int i = 0; i < count * 2; ++i) {
+			data[i * 2] = buf[i] & 255;
+			data[i * 2 + 1] = buf[i] >> 8;
+		}
+		f.write(data, count * 2 * sizeof(int16_t));
+		pos += count;
+	}
+	const uint32_t duration = (uint32_t)(AudioStats::getTimeUs() - timeStamp);
+	free(buf);
+	free(data);
+	mix->stopMusic();
+	mix->free();
+	delete mix;
+	const bool ioErr = f.ioErr();
+	f.close();
+	if (ioErr) {
+		warning("I/O error writing '%s'", renderParameters->filename);
+		return false;
+	}
+	// real time factor of the mixing alone and of the whole render, including the file writes
+	const double seconds = (double)samplesCount / audioParameters->sampleRate;
+	info("Rendered %d seconds of music %d to '%s' in %d ms, %.1fx real time (mixing %.1fx)",
+		renderParameters->duration, renderParameters->music, renderParameters->filename, duration / 1000,
+		seconds * 1000000 / MAX(duration, 1U), seconds * 1000000 / MAX(mixDuration, (uint64_t)1));
+	stub._audioStats.dump(false);
+	return true;
+}
@@ -0,0 +1,24 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef AUDIO_RENDER_H__
+#define AUDIO_RENDER_H__
+
+#include "intern.h"
+
+struct AudioParameters;
+struct FileSystem;
+
+struct AudioRenderParameters {
+	int music; // number passed to Mixer::playMusic
+	int duration; // seconds
+	const char *filename;
+};
+
+// mixes the music as fast as possible, without audio device, and writes it to a WAV file
+extern bool renderAudio(FileSystem *fs, ResourceType version, int midiDriver, const AudioParameters *audioParameters, const AudioRenderParameters *renderParameters);
+
+#endif // AUDIO_RENDER_H__
@@ -0,0 +1,108 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <chrono>
+#include "audio_stats.h"
+#include "util.h"
+
+void AudioStats::Histogram::reset() {
+	for (int i = 0; i < kHistogramBuckets; ++i) {
+		counts[i].store(0, std::memory_order_relaxed);
+	}
+	totalUs.store(0, std::memory_order_relaxed);
+	maxUs.store(0, std::memory_order_relaxed);
+}
+
+void AudioStats::Histogram::add(uint32_t us) {
+	int bucket = 0;
+	for (uint32_t limit = 32; us >= limit && bucket < kHistogramBuckets - 1; limit <<= 1) {
+		++bucket;
+	}
+	// single writer, no read-modify-write needed
+	counts[bucket].store(counts[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	totalUs.store(totalUs.load(std::memory_order_relaxed) + us, std::memory_order_relaxed);
+	if (us > maxUs.load(std::memory_order_relaxed)) {
+		maxUs.store(us, std::memory_order_relaxed);
+	}
+}
+
+void AudioStats::Histogram::dump(bool trace) const {
+	uint32_t count = 0;
+	char buf[512];
+	int len = 0;
+	for (int i = 0; i < kHistogramBuckets; ++i) {
+		const uint32_t n = counts[i].load(std::memory_order_relaxed);
+		if (n != 0) {
+			if (i == kHistogramBuckets - 1) {
+				len += snprintf(buf + len, sizeof(buf) - len, " >=%dus:%d", 32 << (i - 1), n);
+			} else {
+				len += snprintf(buf + len, sizeof(buf) - len, " <%dus:%d", 32 << i, n);
+			}
+			count += n;
+		}
+	}
+	if (count == 0) {
+		return;
+	}
+	const uint32_t avg = (uint32_t)(totalUs.load(std::memory_order_relaxed) / count);
+	const uint32_t max = maxUs.load(std::memory_order_relaxed);
+	if (trace) {
+		debug(DBG_SND, "  %-9s count %d avg %dus max %dus,%s", name, count, avg, max, buf);
+	} else {
+		info("  %-9s count %d avg %dus max %dus,%s", name, count, avg, max, buf);
+	}
+}
+
+AudioStats::AudioStats()
+	: _bufferUs(0) {
+	_callback.name = "callback";
+	_premix.name = "premix";
+	_channels.name = "channels";
+	_lockWait.name = "lock wait";
+	reset(0, 0);
+}
+
+void AudioStats::reset(int bufferSize, int sampleRate) {
+	_callback.reset();
+	_premix.reset();
+	_channels.reset();
+	_lockWait.reset();
+	_callbacks.store(0, std::memory_order_relaxed);
+	_underruns.store(0, std::memory_order_relaxed);
+	_lateCallbacks.store(0, std::memory_order_relaxed);
+	_bufferUs = (sampleRate != 0) ? (uint32_t)((uint64_t)bufferSize * 1000000 / sampleRate) : 0;
+}
+
+void AudioStats::addCallback(uint32_t us) {
+	_callback.add(us);
+	_callbacks.store(_callbacks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if (_bufferUs != 0 && us > _bufferUs) {
+		_lateCallbacks.store(_lateCallbacks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+}
+
+void AudioStats::addUnderrun() {
+	_underruns.store(_underruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void AudioStats::dump(bool trace) const {
+	const uint32_t callbacks = _callbacks.load(std::memory_order_relaxed);
+	const uint32_t underruns = _underruns.load(std::memory_order_relaxed);
+	const uint32_t lateCallbacks = _lateCallbacks.load(std::memory_order_relaxed);
+	if (trace) {
+		debug(DBG_SND, "Audio stats: %d callbacks, deadline %dus, %d underruns, %d late callbacks", callbacks, _bufferUs, underruns, lateCallbacks);
+	} else {
+		info("Audio stats: %d callbacks, deadline %dus, %d underruns, %d late callbacks", callbacks, _bufferUs, underruns, lateCallbacks);
+	}
+	_callback.dump(trace);
+	_premix.dump(trace);
+	_channels.dump(trace);
+	_lockWait.dump(trace);
+}
+
+uint64_t AudioStats::getTimeUs() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,52 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef AUDIO_STATS_H__
+#define AUDIO_STATS_H__
+
+#include <atomic>
+#include "intern.h"
+
+// Timings of the audio callback. Each histogram has a single writer, the
+// audio thread or the thread locking the audio device, and can be dumped at
+// any time from the main thread.
+
+struct AudioStats {
+	enum {
+		kHistogramBuckets = 12 // <32us, <64us, ... <32ms, >=32ms
+	};
+
+	struct Histogram {
+		const char *name;
+		std::atomic<uint32_t> counts[kHistogramBuckets];
+		std::atomic<uint64_t> totalUs;
+		std::atomic<uint32_t> maxUs;
+
+		void reset();
+		void add(uint32_t us);
+		void dump(bool trace) const;
+	};
+
+	Histogram _callback; // whole callback, premix hook and channels
+	Histogram _premix; // music player set with Mixer::setPremixHook
+	Histogram _channels; // sound effects channels
+	Histogram _lockWait; // callers waiting for the audio device lock
+	std::atomic<uint32_t> _callbacks;
+	std::atomic<uint32_t> _underruns; // interval between two callbacks longer than one and a half buffer
+	std::atomic<uint32_t> _lateCallbacks; // callback taking longer than the buffer duration
+	uint32_t _bufferUs;
+
+	AudioStats();
+
+	void reset(int bufferSize, int sampleRate);
+	void addCallback(uint32_t us);
+	void addUnderrun();
+	void dump(bool trace) const;
+
+	static uint64_t getTimeUs();
+};
+
+#endif // AUDIO_STATS_H__
@@ -13,34 +13,52 @@ static const char *_tunes[] = {
 };
 
 CpcPlayer::CpcPlayer(Mixer *mixer, FileSystem *fs)
-	: _mix(mixer), _fs(fs) {
+	: _mix(mixer), _fs(fs), _readBufferPos(0), _readBufferLen(0) {
+	_compression[0] = 0;
 }
 
 CpcPlayer::~CpcPlayer() {
+	_stream.stop();
 }
 
 bool CpcPlayer::playTrack(int num) {
-	_compression[0] = 0;
+	stopTrack();
 	const int tuneNum = num - 2;
 	if (tuneNum >= 0 && tuneNum < ARRAYSIZE(_tunes) && _f.open(_tunes[tuneNum], "rb", _fs)) {
 		_pos = 0;
-		_sampleL = _sampleR = 0;
+		_readBufferPos = _readBufferLen = 0;
+		_samplesLeft = 0;
+		_sample[0] = _sample[1] = 0;
 		while (nextChunk()) {
 			if (_compression[0]) {
 				_restartPos = _nextPos;
+				_resampler.init(_sampleRate, _mix->getSampleRate(), readTrackSamplesProc, this);
+				if (!_resampler.isPassthrough()) {
+					debug(DBG_SND, "Resampling CPC tune from %d to %d Hz", _sampleRate, _mix->getSampleRate());
+				}
+				_stream.start(_mix->getSampleRate(), readSamplesProc, this);
 				_mix->setPremixHook(mixCallback, this);
 				return true;
 			}
+			_pos = _nextPos;
 		}
+		_compression[0] = 0;
+		_f.close();
 	}
 	return false;
 }
 
 void CpcPlayer::stopTrack() {
+	if (_compression[0]) {
+		_mix->setPremixHook(0, 0);
+		_stream.stop();
+		_compression[0] = 0;
+	}
 	_f.close();
 }
 
 void CpcPlayer::pauseTrack() {
+	// the queue is no longer read, the decoding thread fills it and then polls for room every 10ms
 	_mix->setPremixHook(0, 0);
 }
 
@@ -48,39 +66,65 @@ void CpcPlayer::resumeTrack() {
 	_mix->setPremixHook(mixCallback, this);
 }
 
+// returns a pointer to 'len' bytes of the file at offset 'pos', reading a new block if they are not buffered
+const uint8_t *CpcPlayer::readData(uint32_t pos, uint32_t len) {
+	assert(len <= kReadBufferSize);
+	if (pos < _readBufferPos || pos + len > _readBufferPos + _readBufferLen) {
+		_f.seek(pos);
+		_readBufferPos = pos;
+		_readBufferLen = _f.read(_readBuffer, kReadBufferSize);
+		if (len > _readBufferLen) {
+			return 0;
+		}
+	}
+	return _readBuffer + (pos - _readBufferPos);
+}
+
 bool CpcPlayer::nextChunk() {
-	bool found = false;
-	while (!_f.ioErr() && !found) {
-		const uint32_t pos = _pos;
+	const uint8_t *p;
+	while ((p = readData(_pos, 8)) != 0) {
 		char tag[4];
-		_f.read(tag, sizeof(tag));
-		const uint32_t len = _f.readUint32BE();
-		_nextPos = pos + len;
+		memcpy(tag, p, sizeof(tag));
+		const uint32_t len = READ_BE_UINT32(p + 4);
+		if (len < 8) {
+			warning("Invalid CPC chunk '%c%c%c%c' size %d", tag[0], tag[1], tag[2], tag[3], len);
+			break;
+		}
+		_nextPos = _pos + len;
 		if (memcmp(tag, "SNDS", 4) == 0) {
-			_f.readUint32BE();
-			_f.readUint32BE();
-			char type[4];
-			_f.read(type, sizeof(type));
+			p = readData(_pos, 20);
+			if (!p) {
+				break;
+			}
+			const uint8_t *type = p + 16;
 			if (memcmp(type, "SHDR", 4) == 0) {
-				uint8_t buf[24];
-				_f.read(buf, sizeof(buf));
-				const uint32_t rate = _f.readUint32BE();
-				const uint32_t channels = _f.readUint32BE();
-				if (channels != 2 || rate != _mix->getSampleRate()) {
+				p = readData(_pos + 20, 36);
+				if (!p) {
+					break;
+				}
+				const uint32_t rate = READ_BE_UINT32(p + 24);
+				const uint32_t channels = READ_BE_UINT32(p + 28);
+				if (channels != 2 || rate == 0) {
 					warning("Unsupported CPC tune channels %d rate %d", channels, rate);
 					break;
 				}
-				_f.read(_compression, sizeof(_compression) - 1);
+				_sampleRate = rate;
+				memcpy(_compression, p + 32, sizeof(_compression) - 1);
 				_compression[sizeof(_compression) - 1] = 0;
 				if (strcmp(_compression, "SDX2") != 0) {
 					warning("Unsupported CPC compression '%s'", _compression);
 					break;
 				}
-				found = true;
+				_pos = _nextPos;
+				return true;
 			} else if (memcmp(type, "SSMP", 4) == 0) {
-				_samplesLeft = _f.readUint32BE();
-				found = true;
-				break;
+				p = readData(_pos + 20, 4);
+				if (!p) {
+					break;
+				}
+				_samplesLeft = READ_BE_UINT32(p);
+				_dataPos = _pos + 24;
+				return true;
 			} else {
 				warning("Unhandled SNDS chunk '%c%c%c%c'", type[0], type[1], type[2], type[3]);
 			}
@@ -89,10 +133,9 @@ bool CpcPlayer::nextChunk() {
 		} else {
 			warning("Unhandled chunk '%c%c%c%c' size %d", tag[0], tag[1], tag[2], tag[3], len);
 		}
-		_f.seek(_nextPos);
 		_pos = _nextPos;
 	}
-	return found;
+	return false;
 }
 
 static int16_t decodeSDX2(int16_t prev, int8_t data) {
@@ -100,30 +143,65 @@ static int16_t decodeSDX2(int16_t prev, int8_t data) {
 	return (data & 1) != 0 ? prev + sqr : sqr;
 }
 
-int8_t CpcPlayer::readSampleData() {
-	if (_samplesLeft <= 0) {
-		_f.seek(_nextPos);
-		_pos = _nextPos;
-		if (!nextChunk()) {
-			// rewind
-			_f.seek(_restartPos);
-			nextChunk();
-			_sampleL = _sampleR = 0;
+// decodes 'len' stereo samples at the tune rate, looping the track, returns 0 on error
+int CpcPlayer::readTrackSamples(int16_t *buf, int len) {
+	const int samplesLen = len * 2;
+	int count = 0;
+	int rewindCount = -1;
+	while (count < samplesLen) {
+		if (_samplesLeft <= 0) {
+			_pos = _nextPos;
+			if (!nextChunk()) {
+				// rewind, give up if the previous rewind did not produce any sample
+				if (rewindCount == count) {
+					return 0;
+				}
+				rewindCount = count;
+				_pos = _restartPos;
+				_sample[0] = _sample[1] = 0;
+				if (!nextChunk()) {
+					return 0;
+				}
+			}
+			continue;
+		}
+		const uint32_t size = MIN(MIN(_samplesLeft, samplesLen - count), (int)kReadBufferSize);
+		const uint8_t *p = readData(_dataPos, size);
+		if (!p) {
+			warning("Truncated CPC chunk at offset 0x%x", _dataPos);
+			_samplesLeft = 0;
+			continue;
+		}
+		// samples are interleaved, even bytes are for the left channel
+		for (uint32_t i = 0; i < size; ++i, ++count) {
+			int16_t &sample = _sample[count & 1];
+			sample = decodeSDX2(sample, (int8_t)p[i]);
+			buf[count] = sample;
 		}
+		_dataPos += size;
+		_samplesLeft -= size;
 	}
-	const int8_t data = _f.readByte();
-	--_samplesLeft;
-	return data;
+	return len;
 }
 
-bool CpcPlayer::mix(int16_t *buf, int len) {
-	for (int i = 0; i < len; ++i) {
-		_sampleL = decodeSDX2(_sampleL, readSampleData());
-		_sampleR = decodeSDX2(_sampleR, readSampleData());
-		*buf++ = _sampleL;
-		*buf++ = _sampleR;
+int CpcPlayer::readTrackSamplesProc(void *param, int16_t *buf, int len) {
+	return ((CpcPlayer *)param)->readTrackSamples(buf, len);
+}
+
+// decodes 'len' stereo samples at the mixer rate
+int CpcPlayer::readSamples(int16_t *buf, int len) {
+	if (_resampler.isPassthrough()) {
+		return readTrackSamples(buf, len);
 	}
-	return true;
+	return (_resampler.read(buf, len) == len) ? len : 0;
+}
+
+int CpcPlayer::readSamplesProc(void *param, int16_t *buf, int len) {
+	return ((CpcPlayer *)param)->readSamples(buf, len);
+}
+
+bool CpcPlayer::mix(int16_t *buf, int len) {
+	return _stream.read(buf, len);
 }
 
 bool CpcPlayer::mixCallback(void *param, int16_t *buf, int len) {
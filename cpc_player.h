@@ -4,11 +4,16 @@
 
 #include "intern.h"
 #include "file.h"
+#include "pcm_resampler.h"
+#include "pcm_stream.h"
 
 struct FileSystem;
 struct Mixer;
 
 struct CpcPlayer {
+	enum {
+		kReadBufferSize = 16384
+	};
 
 	Mixer *_mix;
 	FileSystem *_fs;
@@ -16,9 +21,16 @@ struct CpcPlayer {
 	uint32_t _pos;
 	uint32_t _nextPos;
 	uint32_t _restartPos;
+	uint32_t _dataPos;
 	char _compression[5];
+	uint32_t _sampleRate;
 	int _samplesLeft;
-	int16_t _sampleL, _sampleR;
+	int16_t _sample[2]; // left and right SDX2 predictors
+	PcmResampler _resampler; // tune sample rate to the mixer rate
+	// the file is read in blocks, the chunk headers and SDX2 data are parsed from memory
+	uint8_t _readBuffer[kReadBufferSize];
+	uint32_t _readBufferPos, _readBufferLen;
+	PcmStream _stream; // decoded ahead of the audio callback
 
 	CpcPlayer(Mixer *mixer, FileSystem *fs);
 	~CpcPlayer();
@@ -28,8 +40,12 @@ struct CpcPlayer {
 	void pauseTrack();
 	void resumeTrack();
 
+	const uint8_t *readData(uint32_t pos, uint32_t len);
 	bool nextChunk();
-	int8_t readSampleData();
+	int readTrackSamples(int16_t *buf, int len);
+	static int readTrackSamplesProc(void *param, int16_t *buf, int len);
+	int readSamples(int16_t *buf, int len);
+	static int readSamplesProc(void *param, int16_t *buf, int len);
 	bool mix(int16_t *buf, int len);
 	static bool mixCallback(void *param, int16_t *buf, int len);
 };
@@ -44,13 +44,14 @@ const uint8_t *Cutscene::getPolygonData() const {
 }
 
 void Cutscene::sync(int frameDelay) {
+	static const int frameHz = 60;
+	_cache.addDelay(frameDelay * (1000 / frameHz));
 	if (_stub->_pi.quit) {
 		return;
 	}
 	if (_stub->_pi.dbgMask & PlayerInput::DF_FASTMODE) {
 		return;
 	}
-	static const int frameHz = 60;
 	const int32_t delay = _stub->getTimeStamp() - _tstamp;
 	const int32_t pause = frameDelay * (1000 / frameHz) - delay;
 	if (pause > 0) {
@@ -77,17 +78,61 @@ void Cutscene::updatePalette() {
 			_stub->setPaletteEntry(0xC0 + i, &c);
 		}
 		_newPal = false;
+		_fullRefresh = true;
 	}
 }
 
 void Cutscene::updateScreen() {
 	sync(_frameDelay - 1);
 	updatePalette();
+	_backPageRect.add(_gfx._dirtyRect);
+	_gfx._dirtyRect.reset();
 	SWAP(_frontPage, _backPage);
-	_stub->copyRect(0, 0, _vid->_w, _vid->_h, _frontPage, _vid->_w);
+	SWAP(_frontPageRect, _backPageRect);
+	recordCacheFrame(_frontPage);
+	copyPage(_frontPage, _frontPageRect);
 	_stub->updateScreen(0);
 }
 
+void Cutscene::markPageDirty(const uint8_t *page, int x, int y, int w, int h) {
+	if (page == _auxPage) {
+		if (_clearScreenBase == 0) {
+			// the pages are cleared with the content of the aux page
+			_frontPageRect.add(x, y, w, h);
+			_backPageRect.add(x, y, w, h);
+			_screenRect.add(x, y, w, h);
+		}
+	} else if (page == _backPage) {
+		_backPageRect.add(x, y, w, h);
+	} else if (page == _frontPage) {
+		_frontPageRect.add(x, y, w, h);
+	}
+}
+
+void Cutscene::setPagesDirty() {
+	_frontPageRect.add(0, 0, _vid->_w, _vid->_h);
+	_backPageRect.add(0, 0, _vid->_w, _vid->_h);
+	_screenRect.add(0, 0, _vid->_w, _vid->_h);
+}
+
+void Cutscene::copyPage(const uint8_t *page, const DirtyRect &pageRect) {
+	// the screen is updated where either the displayed or the new page differs from the cleared page
+	DirtyRect r = _screenRect;
+	r.add(pageRect);
+	if (_fullRefresh) {
+		r.add(0, 0, _vid->_w, _vid->_h);
+		_fullRefresh = false;
+	}
+	r.x1 = MAX(r.x1, 0);
+	r.y1 = MAX(r.y1, 0);
+	r.x2 = MIN(r.x2, _vid->_w - 1);
+	r.y2 = MIN(r.y2, _vid->_h - 1);
+	if (!r.isEmpty()) {
+		_stub->copyRect(r.x1, r.y1, r.x2 - r.x1 + 1, r.y2 - r.y1 + 1, page, _vid->_w);
+	}
+	_screenRect = pageRect;
+}
+
 #if 1
 #define SIN(a) (int16_t)(sin(a * M_PI / 180) * 256)
 #define COS(a) (int16_t)(cos(a * M_PI / 180) * 256)
@@ -194,6 +239,8 @@ void Cutscene::drawText(int16_t x, int16_t y, const uint8_t *p, uint16_t color,
 			// ignore tab
 		} else {
 			(_vid->*dcf)(page, _vid->_w, xPos, yPos, fnt, color, p[i]);
+			const int scale = _vid->_layerScale;
+			markPageDirty(page, (xPos - 1) * scale, (yPos - 1) * scale, (Video::CHAR_W + 2) * scale, (Video::CHAR_H + 2) * scale);
 			xPos += Video::CHAR_W;
 		}
 	}
@@ -205,6 +252,13 @@ void Cutscene::clearBackPage() {
 	} else {
 		memset(_backPage, 0xC0, _vid->_layerSize);
 	}
+	const int base = (_clearScreen == 0) ? 0 : 1;
+	if (_clearScreenBase != base) {
+		_clearScreenBase = base;
+		setPagesDirty();
+	}
+	_backPageRect.reset();
+	_gfx._dirtyRect.reset();
 }
 
 void Cutscene::drawCreditsText() {
@@ -346,6 +400,8 @@ void Cutscene::op_waitForSync() {
 				_creditsTextCounter = _res->isDOS() ? 20 : 60;
 			}
 			memcpy(_backPage, _frontPage, _vid->_layerSize);
+			_backPageRect = _frontPageRect;
+			_gfx._dirtyRect.reset();
 			drawCreditsText();
 			updateScreen();
 		} while (--n);
@@ -449,6 +505,7 @@ void Cutscene::op_drawShape() {
 	}
 	if (_clearScreen != 0) {
 		memcpy(_auxPage, _backPage, _vid->_layerSize);
+		markPageDirty(_auxPage, 0, 0, _vid->_w, _vid->_h);
 	}
 }
 
@@ -477,6 +534,9 @@ void Cutscene::op_drawCaptionText() {
 		memset(_auxPage + y * _vid->_w, 0xC0, h * _vid->_w);
 		memset(_backPage + y * _vid->_w, 0xC0, h * _vid->_w);
 		memset(_frontPage + y * _vid->_w, 0xC0, h * _vid->_w);
+		markPageDirty(_auxPage, 0, y, _vid->_w, h);
+		markPageDirty(_backPage, 0, y, _vid->_w, h);
+		markPageDirty(_frontPage, 0, y, _vid->_w, h);
 		if (strId != 0xFFFF) {
 			const uint8_t *str = _res->getCineString(strId);
 			if (str) {
@@ -971,6 +1031,8 @@ void Cutscene::op_copyScreen() {
 		++_creditsTextCounter;
 	}
 	memcpy(_backPage, _frontPage, _vid->_layerSize);
+	_backPageRect = _frontPageRect;
+	_gfx._dirtyRect.reset();
 	_frameDelay = 10;
 
 	const bool drawMemoShapes = _drawMemoSetShapes && (_paletteNum == 19 || _paletteNum == 23) && (_memoSetOffset + 3) <= sizeof(memoSetPos);
@@ -1000,6 +1062,7 @@ void Cutscene::op_copyScreen() {
 
 	if (drawMemoShapes) {
 		SWAP(_frontPage, _backPage);
+		SWAP(_frontPageRect, _backPageRect);
 	}
 }
 
@@ -1018,9 +1081,13 @@ void Cutscene::op_drawTextAtPos() {
 			// 'voyage' - cutscene script redraws the string to refresh the screen
 			if (_id == kCineVoyage && (strId & 0xFFF) == 0x45) {
 				if ((_cmdPtr - _cmdStartPtr) == 0xA) {
-					_stub->copyRect(0, 0, _vid->_w, _vid->_h, _backPage, _vid->_w);
+					recordCacheFrame(_backPage);
+					_backPageRect.add(_gfx._dirtyRect);
+					_gfx._dirtyRect.reset();
+					copyPage(_backPage, _backPageRect);
 					_stub->updateScreen(0);
 				} else {
+					_cache.addDelay(15);
 					_stub->sleep(15);
 				}
 			}
@@ -1035,6 +1102,10 @@ void Cutscene::op_handleKeys() {
 		if (key_mask == 0xFF) {
 			return;
 		}
+		if (key_mask == 1 || key_mask == 2 || key_mask == 4 || key_mask == 8 || key_mask == 0x80) {
+			// branching on player input, the frames cannot be replayed from the cache
+			_cache.stopRecording(false);
+		}
 		bool b = true;
 		switch (key_mask) {
 		case 1:
@@ -1216,6 +1287,13 @@ void Cutscene::prepare() {
 	_stub->_pi.shift = false;
 	_interrupted = false;
 	_stop = false;
+	_clearScreenBase = -1;
+	_fullRefresh = true;
+	_frontPageRect.reset();
+	_backPageRect.reset();
+	_screenRect.reset();
+	setPagesDirty();
+	_gfx._dirtyRect.reset();
 	const int w = 240;
 	const int h = 128;
 	const int x = (Video::GAMESCREEN_W - w) / 2;
@@ -1357,7 +1435,15 @@ void Cutscene::play() {
 			}
 		} else if (cutName != 0xFFFF) {
 			if (load(cutName)) {
-				mainLoop(cutOff);
+				if (!g_options.use_cutscene_cache || !playCache(cutName, cutOff)) {
+					if (g_options.use_cutscene_cache) {
+						CutsceneCache::Key key;
+						getCacheKey(cutName, cutOff, &key);
+						_cache.startRecording(key, _vid->_layerSize);
+					}
+					mainLoop(cutOff);
+					_cache.stopRecording(!_interrupted && !_stub->_pi.quit);
+				}
 				unload();
 			}
 		} else if (_id == 8 && g_options.play_caillou_cutscene) {
@@ -1510,3 +1596,79 @@ void Cutscene::playSet(const uint8_t *p, int offset) {
 		}
 	}
 }
+
+void Cutscene::getCacheKey(uint16_t cutName, uint16_t cutOff, CutsceneCache::Key *key) const {
+	key->cutName = cutName;
+	key->cutOff = cutOff;
+	key->type = _res->_type;
+	key->lang = _res->_lang;
+	key->flags = (_id == kCineMemo && g_options.restore_memo_cutscene) ? 1 : 0;
+	key->w = _vid->_w;
+	key->h = _vid->_h;
+	key->cmdSize = _res->_cmdSize;
+	key->cmdHash = hashData(_res->_cmd, _res->_cmdSize);
+	key->polSize = _res->_polSize;
+	key->polHash = hashData(_res->_pol, _res->_polSize);
+}
+
+void Cutscene::recordCacheFrame(const uint8_t *frame) {
+	if (_cache._recording) {
+		Color palette[CutsceneCache::kPaletteSize];
+		for (int i = 0; i < CutsceneCache::kPaletteSize; ++i) {
+			_stub->getPaletteEntry(0xC0 + i, &palette[i]);
+		}
+		_cache.recordFrame(frame, palette);
+	}
+}
+
+bool Cutscene::playCache(uint16_t cutName, uint16_t cutOff) {
+	CutsceneCache::Key key;
+	getCacheKey(cutName, cutOff, &key);
+	if (!_cache.openForPlayback(key, _vid->_layerSize)) {
+		return false;
+	}
+	debug(DBG_CUT, "Cutscene::playCache() '%s'", _cache._name);
+	if (_res->isMac()) {
+		_vid->_charShadowColor = 0xE0;
+	}
+	memset(_frontPage, 0, _vid->_layerSize);
+	_tstamp = _stub->getTimeStamp();
+	int count = 0;
+	while (!_stub->_pi.quit && !_interrupted) {
+		uint32_t delay;
+		Color palette[CutsceneCache::kPaletteSize];
+		bool newPalette;
+		const int ret = _cache.readFrame(_frontPage, &delay, palette, &newPalette);
+		if (ret == CutsceneCache::kFrameEnd) {
+			break;
+		} else if (ret == CutsceneCache::kFrameError) {
+			warning("Corrupted cutscene cache file '%s'", _cache._name);
+			_cache.closePlayback(true);
+			// replay the cutscene with the interpreter if nothing was displayed yet
+			return count != 0;
+		}
+		if (!(_stub->_pi.dbgMask & PlayerInput::DF_FASTMODE)) {
+			const int32_t pause = (int32_t)delay - (int32_t)(_stub->getTimeStamp() - _tstamp);
+			if (pause > 0) {
+				_stub->sleep(pause);
+			}
+		}
+		_tstamp = _stub->getTimeStamp();
+		if (newPalette) {
+			for (int i = 0; i < CutsceneCache::kPaletteSize; ++i) {
+				_stub->setPaletteEntry(0xC0 + i, &palette[i]);
+			}
+		}
+		_stub->copyRect(0, 0, _vid->_w, _vid->_h, _frontPage, _vid->_w);
+		_stub->updateScreen(0);
+		++count;
+		_stub->processEvents();
+		if (_stub->_pi.backspace) {
+			_stub->_pi.backspace = false;
+			_interrupted = true;
+		}
+	}
+	_cache.closePlayback(false);
+	memcpy(_backPage, _frontPage, _vid->_layerSize);
+	return true;
+}
@@ -8,6 +8,7 @@
 #define CUTSCENE_H__
 
 #include "intern.h"
+#include "cutscene_cache.h"
 #include "graphics.h"
 
 struct Resource;
@@ -116,6 +117,11 @@ struct Cutscene {
 	uint8_t *_frontPage, *_backPage, *_auxPage;
 	int _paletteNum;
 	bool _isConcavePolygonShape; /* MacPlay logo shape is non-convex */
+	CutsceneCache _cache;
+	DirtyRect _frontPageRect, _backPageRect; // areas differing from the cleared page
+	DirtyRect _screenRect;
+	int _clearScreenBase;
+	bool _fullRefresh;
 
 	Cutscene(Resource *res, SystemStub *stub, Video *vid);
 
@@ -126,6 +132,9 @@ struct Cutscene {
 	void copyPalette(const uint8_t *pal, uint16_t num);
 	void updatePalette();
 	void updateScreen();
+	void markPageDirty(const uint8_t *page, int x, int y, int w, int h);
+	void setPagesDirty();
+	void copyPage(const uint8_t *page, const DirtyRect &pageRect);
 	void setRotationTransform(uint16_t a, uint16_t b, uint16_t c);
 	uint16_t findTextSeparators(const uint8_t *p, int len);
 	void drawText(int16_t x, int16_t y, const uint8_t *p, uint16_t color, uint8_t *page, int textJustify);
@@ -162,6 +171,10 @@ struct Cutscene {
 	void playText(const char *str);
 	void play();
 
+	void getCacheKey(uint16_t cutName, uint16_t cutOff, CutsceneCache::Key *key) const;
+	void recordCacheFrame(const uint8_t *frame);
+	bool playCache(uint16_t cutName, uint16_t cutOff);
+
 	void drawSetShape(const uint8_t *p, uint16_t offset, int x, int y, const uint8_t *paletteLut);
 	void playSet(const uint8_t *p, int offset);
 };
@@ -0,0 +1,233 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <sys/param.h>
+#include "cutscene_cache.h"
+#include "util.h"
+
+static const uint32_t TAG = 0x46424354; // 'FBCT'
+static const uint16_t kCacheVersion = 1;
+
+enum {
+	kOpEnd = 0,
+	kOpFrame = 1
+};
+
+enum {
+	kFlagPalette = 1
+};
+
+static void makeCachePath(char *path, int size, const char *directory, const char *name, const char *ext) {
+	snprintf(path, size, "%s/%s%s", directory, name, ext);
+}
+
+CutsceneCache::CutsceneCache()
+	: _directory(0), _recording(false), _prevFrame(0), _frameSize(0), _delay(0), _hasPalette(false) {
+	_name[0] = 0;
+}
+
+CutsceneCache::~CutsceneCache() {
+	if (_recording) {
+		stopRecording(false);
+	}
+	free(_prevFrame);
+}
+
+void CutsceneCache::setName(const Key &key) {
+	snprintf(_name, sizeof(_name), "rs-cutscene%02d-%02d-%d.cache", key.cutName & 0xFF, key.cutOff, key.lang);
+}
+
+void CutsceneCache::writeKey(const Key &key) {
+	_f.writeUint32BE(TAG);
+	_f.writeUint16BE(kCacheVersion);
+	_f.writeUint16BE(key.cutName);
+	_f.writeUint16BE(key.cutOff);
+	_f.writeByte(key.type);
+	_f.writeByte(key.lang);
+	_f.writeByte(key.flags);
+	_f.writeUint16BE(key.w);
+	_f.writeUint16BE(key.h);
+	_f.writeUint32BE(key.cmdSize);
+	_f.writeUint32BE(key.cmdHash);
+	_f.writeUint32BE(key.polSize);
+	_f.writeUint32BE(key.polHash);
+}
+
+bool CutsceneCache::checkKey(const Key &key) {
+	if (_f.readUint32BE() != TAG || _f.readUint16BE() != kCacheVersion) {
+		return false;
+	}
+	Key k;
+	k.cutName = _f.readUint16BE();
+	k.cutOff = _f.readUint16BE();
+	k.type = _f.readByte();
+	k.lang = _f.readByte();
+	k.flags = _f.readByte();
+	k.w = _f.readUint16BE();
+	k.h = _f.readUint16BE();
+	k.cmdSize = _f.readUint32BE();
+	k.cmdHash = _f.readUint32BE();
+	k.polSize = _f.readUint32BE();
+	k.polHash = _f.readUint32BE();
+	if (_f.ioErr()) {
+		return false;
+	}
+	return k.cutName == key.cutName && k.cutOff == key.cutOff && k.type == key.type && k.lang == key.lang && k.flags == key.flags &&
+		k.w == key.w && k.h == key.h && k.cmdSize == key.cmdSize && k.cmdHash == key.cmdHash && k.polSize == key.polSize && k.polHash == key.polHash;
+}
+
+bool CutsceneCache::openForPlayback(const Key &key, int frameSize) {
+	if (!_directory) {
+		return false;
+	}
+	setName(key);
+	if (!_f.open(_name, "zrb", _directory)) {
+		return false;
+	}
+	if (!checkKey(key)) {
+		debug(DBG_CUT, "Cutscene cache '%s' is outdated", _name);
+		closePlayback(true);
+		return false;
+	}
+	_frameSize = frameSize;
+	return true;
+}
+
+int CutsceneCache::readFrame(uint8_t *frame, uint32_t *delay, Color *palette, bool *newPalette) {
+	const int op = _f.readByte();
+	if (_f.ioErr()) {
+		return kFrameError;
+	}
+	if (op == kOpEnd) {
+		return kFrameEnd;
+	}
+	*delay = _f.readUint16BE();
+	const int flags = _f.readByte();
+	*newPalette = (flags & kFlagPalette) != 0;
+	if (*newPalette) {
+		for (int i = 0; i < kPaletteSize; ++i) {
+			palette[i].r = _f.readByte();
+			palette[i].g = _f.readByte();
+			palette[i].b = _f.readByte();
+		}
+	}
+	// frame is delta encoded as (skip, count, bytes) runs against the previous one
+	int pos = 0;
+	while (pos < _frameSize) {
+		pos += _f.readUint16BE();
+		const int count = _f.readUint16BE();
+		if (_f.ioErr() || pos + count > _frameSize) {
+			return kFrameError;
+		}
+		_f.read(frame + pos, count);
+		pos += count;
+	}
+	return _f.ioErr() ? kFrameError : kFrameData;
+}
+
+void CutsceneCache::closePlayback(bool remove) {
+	_f.close();
+	if (remove) {
+		char path[MAXPATHLEN];
+		makeCachePath(path, sizeof(path), _directory, _name, "");
+		::remove(path);
+	}
+}
+
+bool CutsceneCache::startRecording(const Key &key, int frameSize) {
+	if (!_directory) {
+		return false;
+	}
+	setName(key);
+	char tmpName[sizeof(_name) + 4];
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", _name);
+	if (!_f.open(tmpName, "zwb", _directory)) {
+		warning("Unable to create cutscene cache file '%s'", tmpName);
+		return false;
+	}
+	writeKey(key);
+	if (frameSize != _frameSize || !_prevFrame) {
+		free(_prevFrame);
+		_prevFrame = (uint8_t *)malloc(frameSize);
+		if (!_prevFrame) {
+			warning("Unable to allocate cutscene cache buffer");
+			_f.close();
+			return false;
+		}
+	}
+	memset(_prevFrame, 0, frameSize);
+	_frameSize = frameSize;
+	_delay = 0;
+	_hasPalette = false;
+	_recording = true;
+	return true;
+}
+
+void CutsceneCache::addDelay(int ms) {
+	if (_recording && ms > 0) {
+		_delay += ms;
+	}
+}
+
+void CutsceneCache::recordFrame(const uint8_t *frame, const Color *palette) {
+	if (!_recording) {
+		return;
+	}
+	_f.writeByte(kOpFrame);
+	_f.writeUint16BE(MIN(_delay, 0xFFFFU));
+	_delay = 0;
+	const bool newPalette = !_hasPalette || memcmp(_palette, palette, sizeof(_palette)) != 0;
+	_f.writeByte(newPalette ? kFlagPalette : 0);
+	if (newPalette) {
+		for (int i = 0; i < kPaletteSize; ++i) {
+			_f.writeByte(palette[i].r);
+			_f.writeByte(palette[i].g);
+			_f.writeByte(palette[i].b);
+		}
+		memcpy(_palette, palette, sizeof(_palette));
+		_hasPalette = true;
+	}
+	int pos = 0;
+	while (pos < _frameSize) {
+		int skip = 0;
+		while (pos + skip < _frameSize && skip < 0xFFFF && frame[pos + skip] == _prevFrame[pos + skip]) {
+			++skip;
+		}
+		pos += skip;
+		int count = 0;
+		while (pos + count < _frameSize && count < 0xFFFF && frame[pos + count] != _prevFrame[pos + count]) {
+			++count;
+		}
+		_f.writeUint16BE(skip);
+		_f.writeUint16BE(count);
+		_f.write(frame + pos, count);
+		pos += count;
+	}
+	memcpy(_prevFrame, frame, _frameSize);
+}
+
+void CutsceneCache::stopRecording(bool complete) {
+	if (!_recording) {
+		return;
+	}
+	_recording = false;
+	_f.writeByte(kOpEnd);
+	const bool ioErr = _f.ioErr();
+	_f.close();
+	char tmpPath[MAXPATHLEN];
+	makeCachePath(tmpPath, sizeof(tmpPath), _directory, _name, ".tmp");
+	if (complete && !ioErr) {
+		char path[MAXPATHLEN];
+		makeCachePath(path, sizeof(path), _directory, _name, "");
+		::remove(path);
+		if (rename(tmpPath, path) == 0) {
+			debug(DBG_CUT, "Saved cutscene cache '%s'", _name);
+			return;
+		}
+		warning("Unable to rename cutscene cache file '%s'", tmpPath);
+	}
+	::remove(tmpPath);
+}
@@ -0,0 +1,62 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef CUTSCENE_CACHE_H__
+#define CUTSCENE_CACHE_H__
+
+#include "intern.h"
+#include "file.h"
+
+struct CutsceneCache {
+	enum {
+		kPaletteSize = 32
+	};
+
+	enum {
+		kFrameEnd,
+		kFrameData,
+		kFrameError
+	};
+
+	struct Key {
+		uint16_t cutName;
+		uint16_t cutOff;
+		uint8_t type;
+		uint8_t lang;
+		uint8_t flags;
+		uint16_t w, h;
+		uint32_t cmdSize, cmdHash;
+		uint32_t polSize, polHash;
+	};
+
+	const char *_directory;
+	File _f;
+	char _name[64];
+	bool _recording;
+	uint8_t *_prevFrame;
+	int _frameSize;
+	uint32_t _delay;
+	Color _palette[kPaletteSize];
+	bool _hasPalette;
+
+	CutsceneCache();
+	~CutsceneCache();
+
+	void setName(const Key &key);
+	void writeKey(const Key &key);
+	bool checkKey(const Key &key);
+
+	bool openForPlayback(const Key &key, int frameSize);
+	int readFrame(uint8_t *frame, uint32_t *delay, Color *palette, bool *newPalette);
+	void closePlayback(bool remove);
+
+	bool startRecording(const Key &key, int frameSize);
+	void addDelay(int ms);
+	void recordFrame(const uint8_t *frame, const Color *palette);
+	void stopRecording(bool complete);
+};
+
+#endif // CUTSCENE_CACHE_H__
@@ -5,31 +5,57 @@
 #include "decode_mac.h"
 #include "util.h"
 
-uint8_t *decodeLzss(File &f, uint32_t &decodedSize) {
-	decodedSize = f.readUint32BE();
+uint8_t *decodeLzss(const uint8_t *src, uint32_t srcSize, uint32_t &decodedSize) {
+	if (srcSize < 4) {
+		warning("Invalid LZSS data size %d", srcSize);
+		return 0;
+	}
+	const uint8_t *end = src + srcSize;
+	decodedSize = READ_BE_UINT32(src); src += 4;
 	uint8_t *dst = (uint8_t *)malloc(decodedSize);
 	if (!dst) {
 		warning("Failed to allocate %d bytes for LZSS", decodedSize);
 		return 0;
 	}
 	uint32_t count = 0;
-	while (count < decodedSize) {
-		const int code = f.readByte();
+	while (count < decodedSize && src < end) {
+		const int code = *src++;
 		for (int i = 0; i < 8 && count < decodedSize; ++i) {
 			if ((code & (1 << i)) == 0) {
-				dst[count++] = f.readByte();
+				if (src >= end) {
+					break;
+				}
+				dst[count++] = *src++;
 			} else {
-				int offset = f.readUint16BE();
-				const int len = (offset >> 12) + 3;
-				offset &= 0xFFF;
-				for (int j = 0; j < len; ++j) {
-					dst[count + j] = dst[count - offset - 1 + j];
+				if (end - src < 2) {
+					break;
+				}
+				const int ref = READ_BE_UINT16(src); src += 2;
+				const uint32_t len = (ref >> 12) + 3;
+				const uint32_t offset = (ref & 0xFFF) + 1;
+				if (offset > count || len > decodedSize - count) {
+					warning("Invalid LZSS reference offset %d len %d at %d", offset, len, count);
+					free(dst);
+					return 0;
+				}
+				const uint8_t *p = dst + count - offset;
+				if (offset >= len) {
+					memcpy(dst + count, p, len);
+				} else {
+					// overlapping, repeats the last 'offset' bytes
+					for (uint32_t j = 0; j < len; ++j) {
+						dst[count + j] = p[j];
+					}
 				}
 				count += len;
 			}
 		}
 	}
-	assert(count == decodedSize);
+	if (count != decodedSize) {
+		warning("Truncated LZSS data, decoded %d bytes out of %d", count, decodedSize);
+		free(dst);
+		return 0;
+	}
 	return dst;
 }
 
@@ -3,9 +3,10 @@
 #define DECODE_MAC_H__
 
 #include <stdint.h>
-#include "file.h"
+#include "intern.h"
 
-uint8_t *decodeLzss(File &f, uint32_t &decodedSize);
+// 'src' starts with the decoded size, 32 bits big endian
+uint8_t *decodeLzss(const uint8_t *src, uint32_t srcSize, uint32_t &decodedSize);
 
 struct DecodeBuffer {
 	uint8_t *ptr;
@@ -16,6 +16,11 @@
 #include <SDL_filesystem.h>
 #include <SDL_rwops.h>
 #endif
+#ifdef USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 struct File_impl {
 	bool _ioErr;
@@ -28,6 +33,7 @@ struct File_impl {
 	virtual uint32_t tell() = 0;
 	virtual uint32_t read(void *ptr, uint32_t len) = 0;
 	virtual uint32_t write(const void *ptr, uint32_t len) = 0;
+	virtual const uint8_t *getData() { return 0; }
 };
 
 struct StdioFile : File_impl {
@@ -152,6 +158,79 @@ struct GzipFile : File_impl {
 };
 #endif
 
+#ifdef USE_MMAP
+struct MmapFile : File_impl {
+	uint8_t *_ptr;
+	uint32_t _size, _offset;
+	MmapFile() : _ptr(0), _size(0), _offset(0) {}
+	bool open(const char *path, const char *mode) {
+		_ioErr = false;
+		assert(mode[0] == 'r');
+		const int fd = ::open(path, O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		bool ret = false;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+			_size = st.st_size;
+			_offset = 0;
+			if (_size == 0) {
+				ret = true;
+			} else {
+				void *p = mmap(0, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p != MAP_FAILED) {
+					_ptr = (uint8_t *)p;
+					ret = true;
+				}
+			}
+		}
+		// the mapping stays valid after the descriptor is closed
+		::close(fd);
+		return ret;
+	}
+	void close() {
+		if (_ptr) {
+			munmap(_ptr, _size);
+			_ptr = 0;
+		}
+		_size = _offset = 0;
+	}
+	uint32_t size() {
+		return _size;
+	}
+	void seek(int32_t off) {
+		_offset = off;
+	}
+	uint32_t tell() {
+		return _offset;
+	}
+	uint32_t read(void *ptr, uint32_t len) {
+		uint32_t count = len;
+		if (_offset >= _size) {
+			count = 0;
+		} else if (count > _size - _offset) {
+			count = _size - _offset;
+		}
+		if (count != len) {
+			_ioErr = true;
+		}
+		if (count != 0) {
+			memcpy(ptr, _ptr + _offset, count);
+			_offset += count;
+		}
+		return count;
+	}
+	uint32_t write(const void *ptr, uint32_t len) {
+		_ioErr = true;
+		return 0;
+	}
+	const uint8_t *getData() {
+		return _ptr;
+	}
+};
+#endif
+
 #ifdef USE_RWOPS
 struct AssetFile: File_impl {
 	SDL_RWops *_rw;
@@ -225,6 +304,11 @@ struct MemoryBufferFile: File_impl {
 		_ptr = (uint8_t *)malloc(_capacity);
 		_offset = _len = 0;
 	}
+	MemoryBufferFile(uint8_t *data, uint32_t size) {
+		_capacity = _len = size;
+		_ptr = data;
+		_offset = 0;
+	}
 	~MemoryBufferFile() {
 		free(_ptr);
 	}
@@ -242,6 +326,9 @@ struct MemoryBufferFile: File_impl {
 	void seek(int offs) {
 		_offset = offs;
 	}
+	const uint8_t *getData() {
+		return _ptr;
+	}
 	uint32_t read(void *ptr, uint32_t len) {
 		int count = len;
 		if (_offset + count > _len) {
@@ -291,6 +378,19 @@ bool File::open(const char *filename, const char *mode, FileSystem *fs) {
 	char *path = fs->findPath(filename);
 	if (path) {
 		debug(DBG_FILE, "Open file name '%s' mode '%s' path '%s'", filename, mode, path);
+#ifdef USE_MMAP
+		// game data files are read-only, map them instead of going through stdio
+		if (strcmp(mode, "rb") == 0) {
+			File_impl *impl = new MmapFile;
+			if (impl->open(path, mode)) {
+				delete _impl;
+				_impl = impl;
+				free(path);
+				return true;
+			}
+			delete impl;
+		}
+#endif
 		bool ret = _impl->open(path, mode);
 		free(path);
 		return ret;
@@ -321,6 +421,20 @@ bool File::open(const char *filename, const char *mode, const char *directory) {
 		delete _impl;
 		_impl = 0;
 	}
+	char path[MAXPATHLEN];
+	snprintf(path, sizeof(path), "%s/%s", directory, filename);
+	debug(DBG_FILE, "Open file name '%s' mode '%s' path '%s'", filename, mode, path);
+#ifdef USE_MMAP
+	// only the uncompressed files are mapped, the 'z' modes go through zlib
+	if (strcmp(mode, "rb") == 0) {
+		File_impl *impl = new MmapFile;
+		if (impl->open(path, mode)) {
+			_impl = impl;
+			return true;
+		}
+		delete impl;
+	}
+#endif
 #ifdef USE_ZLIB
 	if (mode[0] == 'z') {
 		_impl = new GzipFile;
@@ -330,9 +444,6 @@ bool File::open(const char *filename, const char *mode, const char *directory) {
 	if (!_impl) {
 		_impl = new StdioFile;
 	}
-	char path[MAXPATHLEN];
-	snprintf(path, sizeof(path), "%s/%s", directory, filename);
-	debug(DBG_FILE, "Open file name '%s' mode '%s' path '%s'", filename, mode, path);
 	return _impl->open(path, mode);
 }
 
@@ -345,6 +456,15 @@ void File::openMemoryBuffer(int initialCapacity) {
 	_impl = new MemoryBufferFile(initialCapacity);
 }
 
+void File::openMemoryBuffer(uint8_t *data, uint32_t size) {
+	if (_impl) {
+		_impl->close();
+		delete _impl;
+		_impl = 0;
+	}
+	_impl = new MemoryBufferFile(data, size);
+}
+
 void File::close() {
 	if (_impl) {
 		_impl->close();
@@ -371,6 +491,32 @@ uint32_t File::read(void *ptr, uint32_t len) {
 	return _impl->read(ptr, len);
 }
 
+const uint8_t *File::getData(uint32_t *size) {
+	const uint8_t *p = _impl ? _impl->getData() : 0;
+	if (p && size) {
+		*size = _impl->size();
+	}
+	return p;
+}
+
+const uint8_t *File::readData(uint32_t len, uint8_t **buf) {
+	*buf = 0;
+	uint32_t size;
+	const uint8_t *p = getData(&size);
+	if (p) {
+		const uint32_t pos = tell();
+		if (pos <= size && len <= size - pos) {
+			seek(pos + len);
+			return p + pos;
+		}
+	}
+	*buf = (uint8_t *)malloc(len);
+	if (*buf) {
+		read(*buf, len);
+	}
+	return *buf;
+}
+
 uint8_t File::readByte() {
 	uint8_t b;
 	read(&b, 1);
@@ -21,12 +21,18 @@ struct File {
 	bool open(const char *filename, const char *mode, FileSystem *fs);
 	bool open(const char *filename, const char *mode, const char *directory);
 	void openMemoryBuffer(int initialCapacity);
+	// reads from a buffer allocated with malloc, freed with the file
+	void openMemoryBuffer(uint8_t *data, uint32_t size);
 	void close();
 	bool ioErr() const;
 	uint32_t size();
 	void seek(int32_t off);
 	uint32_t tell();
 	uint32_t read(void *ptr, uint32_t len);
+	// file content if the file is memory mapped, valid until the file is closed
+	const uint8_t *getData(uint32_t *size);
+	// 'len' bytes at the current position, copied to a buffer allocated in *buf if the file is not mapped
+	const uint8_t *readData(uint32_t len, uint8_t **buf);
 	uint8_t readByte();
 	uint16_t readUint16LE();
 	uint32_t readUint32LE();
@@ -0,0 +1,52 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+// 'make check' : the files written by the game in the save directory are read back with the same mode
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "file.h"
+#include "util.h"
+
+static const char *kFileName = "rs-file-test.tmp";
+
+static bool checkMode(const char *directory, const char *writeMode, const char *readMode) {
+	static const uint8_t data[] = { 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0 };
+	File f;
+	if (!f.open(kFileName, writeMode, directory)) {
+		warning("Unable to open '%s' with mode '%s'", kFileName, writeMode);
+		return false;
+	}
+	f.writeUint32BE(0x12345678);
+	f.write(data, sizeof(data));
+	f.close();
+	if (!f.open(kFileName, readMode, directory)) {
+		warning("Unable to open '%s' with mode '%s'", kFileName, readMode);
+		return false;
+	}
+	const uint32_t tag = f.readUint32BE();
+	uint8_t buf[sizeof(data)];
+	const uint32_t count = f.read(buf, sizeof(buf));
+	f.close();
+	if (tag != 0x12345678 || count != sizeof(buf) || memcmp(buf, data, sizeof(data)) != 0) {
+		warning("Data written with mode '%s' read back with mode '%s' differs, tag 0x%08x", writeMode, readMode, tag);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	const char *directory = (argc > 1) ? argv[1] : ".";
+	bool ret = checkMode(directory, "wb", "rb");
+#ifdef USE_ZLIB
+	ret = checkMode(directory, "zwb", "zrb") && ret;
+#endif
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s", directory, kFileName);
+	unlink(path);
+	info("File modes check %s", ret ? "passed" : "failed");
+	return ret ? 0 : 1;
+}
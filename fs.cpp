@@ -15,6 +15,7 @@
 #ifdef USE_RWOPS
 #include <SDL_rwops.h>
 #endif
+#include <ctype.h>
 #include "fs.h"
 #include "util.h"
 
@@ -23,35 +24,104 @@ struct FileName {
 	int dir;
 };
 
+// FNV-1a of the lowercased name
+static uint32_t hashFileName(const char *name) {
+	uint32_t hash = 0x811C9DC5;
+	for (; *name; ++name) {
+		hash ^= (uint8_t)tolower((uint8_t)*name);
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
+static const char *kIndexFileName = "rs-files.index";
+static const char *kIndexHeader = "REminiscence files index 1";
+
 struct FileSystem_impl {
 
 	char **_dirsList;
-	int _dirsCount;
+	time_t *_dirsTime; // modification time of the directories, to check the index file
+	int _dirsCount, _dirsCapacity;
 	FileName *_filesList;
-	int _filesCount;
+	int _filesCount, _filesCapacity;
+	int *_filesHash; // open addressing table of _filesList indexes, -1 for free slots
+	uint32_t _filesHashMask;
 
 	FileSystem_impl() :
-		_dirsList(0), _dirsCount(0), _filesList(0), _filesCount(0) {
+		_dirsList(0), _dirsTime(0), _dirsCount(0), _dirsCapacity(0), _filesList(0), _filesCount(0), _filesCapacity(0), _filesHash(0), _filesHashMask(0) {
 	}
 
 	~FileSystem_impl() {
+		clear();
+	}
+
+	void clear() {
 		for (int i = 0; i < _dirsCount; ++i) {
 			free(_dirsList[i]);
 		}
 		free(_dirsList);
+		_dirsList = 0;
+		free(_dirsTime);
+		_dirsTime = 0;
+		_dirsCount = _dirsCapacity = 0;
 		for (int i = 0; i < _filesCount; ++i) {
 			free(_filesList[i].name);
 		}
 		free(_filesList);
+		_filesList = 0;
+		_filesCount = _filesCapacity = 0;
+		free(_filesHash);
+		_filesHash = 0;
 	}
 
-	void setRootDirectory(const char *dir) {
-		getPathListFromDirectory(dir);
+	void setRootDirectory(const char *dir, const char *indexDirectory) {
+		if (!indexDirectory || !loadIndex(dir, indexDirectory)) {
+			getPathListFromDirectory(dir);
+			if (indexDirectory) {
+				saveIndex(dir, indexDirectory);
+			}
+		}
 		debug(DBG_FILE, "Found %d files and %d directories", _filesCount, _dirsCount);
+		buildHashTable();
 	}
 
-	int findPathIndex(const char *name) const {
+	void buildHashTable() {
+		uint32_t size = 16;
+		while (size < (uint32_t)_filesCount * 2) {
+			size *= 2;
+		}
+		_filesHash = (int *)malloc(size * sizeof(int));
+		if (!_filesHash) {
+			warning("Unable to allocate %d entries for the files index", size);
+			return;
+		}
+		_filesHashMask = size - 1;
+		for (uint32_t i = 0; i < size; ++i) {
+			_filesHash[i] = -1;
+		}
 		for (int i = 0; i < _filesCount; ++i) {
+			// keep the first of the files with the same name, like a linear search would
+			uint32_t slot = hashFileName(_filesList[i].name) & _filesHashMask;
+			while (_filesHash[slot] != -1 && strcasecmp(_filesList[_filesHash[slot]].name, _filesList[i].name) != 0) {
+				slot = (slot + 1) & _filesHashMask;
+			}
+			if (_filesHash[slot] == -1) {
+				_filesHash[slot] = i;
+			}
+		}
+	}
+
+	int findPathIndex(const char *name) const {
+		if (!_filesHash) {
+			for (int i = 0; i < _filesCount; ++i) {
+				if (strcasecmp(_filesList[i].name, name) == 0) {
+					return i;
+				}
+			}
+			return -1;
+		}
+		for (uint32_t slot = hashFileName(name) & _filesHashMask; _filesHash[slot] != -1; slot = (slot + 1) & _filesHashMask) {
+			const int i = _filesHash[slot];
 			if (strcasecmp(_filesList[i].name, name) == 0) {
 				return i;
 			}
@@ -73,31 +143,47 @@ struct FileSystem_impl {
 		return 0;
 	}
 
-	void addPath(const char *dir, const char *name) {
-		int index = -1;
-		for (int i = 0; i < _dirsCount; ++i) {
-			if (strcmp(_dirsList[i], dir) == 0) {
-				index = i;
-				break;
+	int addDirectory(const char *dir, time_t mtime) {
+		if (_dirsCount == _dirsCapacity) {
+			const int capacity = _dirsCapacity ? _dirsCapacity * 2 : 16;
+			char **dirsList = (char **)realloc(_dirsList, capacity * sizeof(char *));
+			if (!dirsList) {
+				return -1;
 			}
-		}
-		if (index == -1) {
-			_dirsList = (char **)realloc(_dirsList, (_dirsCount + 1) * sizeof(char *));
-			if (_dirsList) {
-				_dirsList[_dirsCount] = strdup(dir);
-				index = _dirsCount;
-				++_dirsCount;
+			_dirsList = dirsList;
+			time_t *dirsTime = (time_t *)realloc(_dirsTime, capacity * sizeof(time_t));
+			if (!dirsTime) {
+				return -1;
 			}
+			_dirsTime = dirsTime;
+			_dirsCapacity = capacity;
 		}
-		_filesList = (FileName *)realloc(_filesList, (_filesCount + 1) * sizeof(FileName));
-		if (_filesList) {
-			_filesList[_filesCount].name = strdup(name);
-			_filesList[_filesCount].dir = index;
-			++_filesCount;
+		_dirsList[_dirsCount] = strdup(dir);
+		_dirsTime[_dirsCount] = mtime;
+		return _dirsCount++;
+	}
+
+	void addFile(int dir, const char *name) {
+		if (dir < 0) {
+			return;
+		}
+		if (_filesCount == _filesCapacity) {
+			const int capacity = _filesCapacity ? _filesCapacity * 2 : 256;
+			FileName *filesList = (FileName *)realloc(_filesList, capacity * sizeof(FileName));
+			if (!filesList) {
+				return;
+			}
+			_filesList = filesList;
+			_filesCapacity = capacity;
 		}
+		_filesList[_filesCount].name = strdup(name);
+		_filesList[_filesCount].dir = dir;
+		++_filesCount;
 	}
 
 	void getPathListFromDirectory(const char *dir);
+	bool loadIndex(const char *dir, const char *indexDirectory);
+	void saveIndex(const char *dir, const char *indexDirectory);
 };
 
 #ifdef _WIN32
@@ -107,6 +193,7 @@ void FileSystem_impl::getPathListFromDirectory(const char *dir) {
 	snprintf(searchPath, sizeof(searchPath), "%s/*", dir);
 	HANDLE h = FindFirstFile(searchPath, &findData);
 	if (h) {
+		const int index = addDirectory(dir, 0);
 		do {
 			if (findData.cFileName[0] == '.') {
 				continue;
@@ -116,16 +203,26 @@ void FileSystem_impl::getPathListFromDirectory(const char *dir) {
 			if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
 				getPathListFromDirectory(filePath);
 			} else {
-				addPath(dir, findData.cFileName);
+				addFile(index, findData.cFileName);
 			}
 		} while (FindNextFile(h, &findData));
 		FindClose(h);
 	}
 }
+
+// the modification times are not tracked, always scan the data directory
+bool FileSystem_impl::loadIndex(const char *dir, const char *indexDirectory) {
+	return false;
+}
+
+void FileSystem_impl::saveIndex(const char *dir, const char *indexDirectory) {
+}
 #else
 void FileSystem_impl::getPathListFromDirectory(const char *dir) {
 	DIR *d = opendir(dir);
 	if (d) {
+		struct stat st;
+		const int index = addDirectory(dir, (fstat(dirfd(d), &st) == 0) ? st.st_mtime : 0);
 		dirent *de;
 		while ((de = readdir(d)) != NULL) {
 			if (de->d_name[0] == '.') {
@@ -133,23 +230,121 @@ void FileSystem_impl::getPathListFromDirectory(const char *dir) {
 			}
 			char filePath[MAXPATHLEN];
 			snprintf(filePath, sizeof(filePath), "%s/%s", dir, de->d_name);
-			struct stat st;
-			if (stat(filePath, &st) == 0) {
-				if (S_ISDIR(st.st_mode)) {
-					getPathListFromDirectory(filePath);
-				} else {
-					addPath(dir, de->d_name);
+			bool isDirectory;
+#ifdef DT_DIR
+			if (de->d_type == DT_DIR) {
+				isDirectory = true;
+			} else if (de->d_type == DT_REG) {
+				isDirectory = false;
+			} else
+#endif
+			{
+				// unknown type or symbolic link
+				if (stat(filePath, &st) != 0) {
+					continue;
 				}
+				isDirectory = S_ISDIR(st.st_mode);
+			}
+			if (isDirectory) {
+				getPathListFromDirectory(filePath);
+			} else {
+				addFile(index, de->d_name);
 			}
 		}
 		closedir(d);
 	}
 }
+
+static char *readIndexLine(char *buf, int size, FILE *fp) {
+	if (!fgets(buf, size, fp)) {
+		return 0;
+	}
+	char *p = strchr(buf, '\n');
+	if (!p) {
+		return 0;
+	}
+	*p = 0;
+	return buf;
+}
+
+// the index is only used if none of the directories were modified since it was written
+bool FileSystem_impl::loadIndex(const char *dir, const char *indexDirectory) {
+	char path[MAXPATHLEN];
+	snprintf(path, sizeof(path), "%s/%s", indexDirectory, kIndexFileName);
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		return false;
+	}
+	char buf[MAXPATHLEN + 32];
+	bool ret = readIndexLine(buf, sizeof(buf), fp) && strcmp(buf, kIndexHeader) == 0;
+	if (ret) {
+		ret = readIndexLine(buf, sizeof(buf), fp) && buf[0] == 'R' && buf[1] == ' ' && strcmp(buf + 2, dir) == 0;
+	}
+	while (ret && readIndexLine(buf, sizeof(buf), fp)) {
+		char *p;
+		if (buf[0] == 'D' && buf[1] == ' ') {
+			const time_t mtime = (time_t)strtoll(buf + 2, &p, 10);
+			struct stat st;
+			if (*p != ' ' || stat(p + 1, &st) != 0 || !S_ISDIR(st.st_mode) || st.st_mtime != mtime) {
+				debug(DBG_FILE, "Directory '%s' modified", p + 1);
+				ret = false;
+			} else {
+				ret = addDirectory(p + 1, mtime) >= 0;
+			}
+		} else if (buf[0] == 'F' && buf[1] == ' ') {
+			const int index = strtol(buf + 2, &p, 10);
+			if (*p != ' ' || index < 0 || index >= _dirsCount) {
+				ret = false;
+			} else {
+				addFile(index, p + 1);
+			}
+		} else {
+			ret = false;
+		}
+	}
+	fclose(fp);
+	// an index without directories was written when the data directory could not be read
+	if (!ret || _dirsCount == 0) {
+		clear();
+		return false;
+	}
+	debug(DBG_FILE, "Loaded files index '%s'", path);
+	return true;
+}
+
+void FileSystem_impl::saveIndex(const char *dir, const char *indexDirectory) {
+	if (_dirsCount == 0) {
+		// the data directory could not be opened, scan it again on the next start
+		return;
+	}
+	char path[MAXPATHLEN];
+	snprintf(path, sizeof(path), "%s/%s", indexDirectory, kIndexFileName);
+	char tmpPath[MAXPATHLEN + 8];
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+	FILE *fp = fopen(tmpPath, "wb");
+	if (!fp) {
+		warning("Unable to create files index '%s'", tmpPath);
+		return;
+	}
+	fprintf(fp, "%s\nR %s\n", kIndexHeader, dir);
+	for (int i = 0; i < _dirsCount; ++i) {
+		fprintf(fp, "D %lld %s\n", (long long)_dirsTime[i], _dirsList[i]);
+	}
+	for (int i = 0; i < _filesCount; ++i) {
+		fprintf(fp, "F %d %s\n", _filesList[i].dir, _filesList[i].name);
+	}
+	const bool ioErr = ferror(fp) != 0;
+	fclose(fp);
+	if (ioErr || rename(tmpPath, path) != 0) {
+		warning("Unable to write files index '%s'", path);
+		remove(tmpPath);
+	}
+}
 #endif
 
-FileSystem::FileSystem(const char *dataPath) {
+FileSystem::FileSystem(const char *dataPath, const char *indexDirectory) {
 	_impl = new FileSystem_impl;
-	_impl->setRootDirectory(dataPath);
+	_impl->setRootDirectory(dataPath, indexDirectory);
 }
 
 FileSystem::~FileSystem() {
@@ -12,7 +12,7 @@
 struct FileSystem_impl;
 
 struct FileSystem {
-	FileSystem(const char *dataPath);
+	FileSystem(const char *dataPath, const char *indexDirectory = 0);
 	~FileSystem();
 
 	FileSystem_impl *_impl;
@@ -27,6 +27,9 @@ Game::Game(SystemStub *stub, FileSystem *fs, const char *savePath, int level, Re
 	_rewindPtr = -1;
 	_rewindLen = 0;
 	_cheats = cheats;
+	_cut._cache._directory = savePath;
+	_mix._musicCache._directory = savePath;
+	_res._unpackCache._directory = g_options.use_unpack_cache ? savePath : 0;
 }
 
 void Game::run() {
@@ -73,6 +76,7 @@ void Game::run() {
 
 	_mix.init();
 	_mix._mod._isAmiga = _res.isAmiga();
+	_res._sfxOutputRate = _mix.getSampleRate();
 
 	if (_res.isMac()) {
 		_menu.displayTitleScreenMac(Menu::kMacTitleScreen_MacPlay);
@@ -1608,91 +1612,123 @@ void Game::loadLevelRoom() {
 	}
 }
 
+int Game::getLevelLoadJobs(int level, Resource::LoadJob *jobs, char *splName, int splNameSize) const {
+	const Level *lvl = &_gameLevels[level];
+	int count = 0;
+	if (_res.isAmiga()) {
+		const char *name = lvl->nameAmiga;
+		if (level == 4) {
+			name = _gameLevels[3].nameAmiga;
+		}
+		jobs[count++] = { name, Resource::OT_MBK, 0 };
+		if (level == 6) {
+			jobs[count++] = { _gameLevels[5].nameAmiga, Resource::OT_CT, 0 };
+		} else {
+			jobs[count++] = { name, Resource::OT_CT, 0 };
+		}
+		jobs[count++] = { name, Resource::OT_PAL, 0 };
+		jobs[count++] = { name, Resource::OT_RPC, 0 };
+		jobs[count++] = { name, Resource::OT_SPC, 0 };
+		if (level == 1) {
+			jobs[count++] = { "level2_1", Resource::OT_LEV, 0 };
+		} else {
+			jobs[count++] = { name, Resource::OT_LEV, 0 };
+		}
+		jobs[count++] = { lvl->nameAmiga, Resource::OT_PGE, 0 };
+		jobs[count++] = { lvl->nameAmiga, Resource::OT_OBC, 0 };
+		jobs[count++] = { lvl->nameAmiga, Resource::OT_ANI, 0 };
+		jobs[count++] = { lvl->nameAmiga, Resource::OT_TBN, 0 };
+		snprintf(splName, splNameSize, "level%d", lvl->sound);
+		jobs[count++] = { splName, Resource::OT_SPL, 0 };
+		if (level == 0) {
+			jobs[count++] = { lvl->nameAmiga, Resource::OT_SGD, 0 };
+		}
+		return count;
+	}
+	jobs[count++] = { lvl->name, Resource::OT_MBK, 0 };
+	jobs[count++] = { lvl->name, Resource::OT_CT, 0 };
+	jobs[count++] = { lvl->name, Resource::OT_PAL, 0 };
+	jobs[count++] = { lvl->name, Resource::OT_RP, 0 };
+	if (_res.isPC98()) {
+		// Resource::PC98_loadLevelMap
+	} else if (_res._isDemo || g_options.use_tile_data || _res._aba) { // use .BNQ/.LEV/(.SGD) instead of .MAP (PC demo)
+		if (level == 0) {
+			jobs[count++] = { lvl->name, Resource::OT_SGD, 0 };
+		}
+		jobs[count++] = { lvl->name, Resource::OT_LEV, 0 };
+		jobs[count++] = { lvl->name, Resource::OT_BNQ, 0 };
+	} else if (_res.isSega()) {
+		if (level == 0) {
+			jobs[count++] = { lvl->name, Resource::OT_SGD, 0 };
+		}
+		jobs[count++] = { lvl->name, Resource::OT_LEV, 0 };
+	} else {
+		jobs[count++] = { lvl->name, Resource::OT_MAP, 0 };
+	}
+	jobs[count++] = { lvl->name2, Resource::OT_PGE, 0 };
+	if (!_res.isSega()) {
+		jobs[count++] = { lvl->name2, Resource::OT_OBJ, 0 };
+		jobs[count++] = { lvl->name2, Resource::OT_ANI, 0 };
+	}
+	jobs[count++] = { lvl->name2, Resource::OT_TBN, 0 };
+	return count;
+}
+
+// the levels are played in order, read the files of the next one in the background
+void Game::stageNextLevelData() {
+	if (_res._isDemo || _res.isMac() || _demoBin != -1 || _currentLevel + 1 >= 7) { // level 7 is the ending cutscene
+		return;
+	}
+	Resource::LoadJob jobs[16];
+	char splName[32];
+	const int count = getLevelLoadJobs(_currentLevel + 1, jobs, splName, sizeof(splName));
+	_res.stageLevelData(_currentLevel + 1, jobs, count);
+}
+
 void Game::loadLevelData() {
 	_res.clearLevelRes();
 	const Level *lvl = &_gameLevels[_currentLevel];
+	// the resource types are independent, they are read and decoded concurrently
+	Resource::LoadJob jobs[16];
+	int count = 0;
 	switch (_res._type) {
 	case kResourceTypeAmiga:
 		if (_res._isDemo) {
 			static const char *fname1 = "demo";
 			static const char *fname2 = "demof";
-			_res.load(fname1, Resource::OT_MBK);
-			_res.load(fname1, Resource::OT_CT);
-			_res.load(fname1, Resource::OT_PAL);
-			_res.load(fname1, Resource::OT_RPC);
-			_res.load(fname1, Resource::OT_SPC);
-			_res.load(fname1, Resource::OT_LEV);
-			_res.load(fname2, Resource::OT_PGE);
-			_res.load(fname1, Resource::OT_OBJ);
-			_res.load(fname1, Resource::OT_ANI);
-			_res.load(fname2, Resource::OT_TBN);
+			jobs[count++] = { fname1, Resource::OT_MBK, 0 };
+			jobs[count++] = { fname1, Resource::OT_CT, 0 };
+			jobs[count++] = { fname1, Resource::OT_PAL, 0 };
+			jobs[count++] = { fname1, Resource::OT_RPC, 0 };
+			jobs[count++] = { fname1, Resource::OT_SPC, 0 };
+			jobs[count++] = { fname1, Resource::OT_LEV, 0 };
+			jobs[count++] = { fname2, Resource::OT_PGE, 0 };
+			jobs[count++] = { fname1, Resource::OT_OBJ, 0 };
+			jobs[count++] = { fname1, Resource::OT_ANI, 0 };
+			jobs[count++] = { fname2, Resource::OT_TBN, 0 };
+			jobs[count++] = { "level1", Resource::OT_SGD, 0 };
+			_res.loadJobs(jobs, count);
 			_res.load_SPL_demo();
-			_res.load("level1", Resource::OT_SGD);
 			break;
 		}
-		{
-			const char *name = lvl->nameAmiga;
-			if (_currentLevel == 4) {
-				name = _gameLevels[3].nameAmiga;
-			}
-			_res.load(name, Resource::OT_MBK);
-			if (_currentLevel == 6) {
-				_res.load(_gameLevels[5].nameAmiga, Resource::OT_CT);
-			} else {
-				_res.load(name, Resource::OT_CT);
-			}
-			_res.load(name, Resource::OT_PAL);
-			_res.load(name, Resource::OT_RPC);
-			_res.load(name, Resource::OT_SPC);
-			if (_currentLevel == 1) {
-				_res.load("level2_1", Resource::OT_LEV);
-				_res._levNum = 1;
-			} else {
-				_res.load(name, Resource::OT_LEV);
-			}
-		}
-		_res.load(lvl->nameAmiga, Resource::OT_PGE);
-		_res.load(lvl->nameAmiga, Resource::OT_OBC);
-		_res.load(lvl->nameAmiga, Resource::OT_ANI);
-		_res.load(lvl->nameAmiga, Resource::OT_TBN);
-		{
-			char name[32];
-			snprintf(name, sizeof(name), "level%d", lvl->sound);
-			_res.load(name, Resource::OT_SPL);
-		}
-		if (_currentLevel == 0) {
-			_res.load(lvl->nameAmiga, Resource::OT_SGD);
-		}
-		break;
+		// fall-through
 	case kResourceTypeDOS:
 	case kResourceTypePC98:
-	case kResourceTypeSega:
-		_res.load(lvl->name, Resource::OT_MBK);
-		_res.load(lvl->name, Resource::OT_CT);
-		_res.load(lvl->name, Resource::OT_PAL);
-		_res.load(lvl->name, Resource::OT_RP);
-		if (_res.isPC98()) {
-			_res.PC98_loadLevelMap(_currentLevel);
-		} else if (_res._isDemo || g_options.use_tile_data || _res._aba) { // use .BNQ/.LEV/(.SGD) instead of .MAP (PC demo)
-			if (_currentLevel == 0) {
-				_res.load(lvl->name, Resource::OT_SGD);
+	case kResourceTypeSega: {
+			char splName[32];
+			count = getLevelLoadJobs(_currentLevel, jobs, splName, sizeof(splName));
+			const bool staged = _res.useStagedLevelData(_currentLevel);
+			_res.loadJobs(jobs, count);
+			if (staged) {
+				_res.clearStagedLevelData();
+			}
+			if (_res.isAmiga() && _currentLevel == 1) {
+				_res._levNum = 1;
 			}
-			_res.load(lvl->name, Resource::OT_LEV);
-			_res.load(lvl->name, Resource::OT_BNQ);
-		} else if (_res.isSega()) {
-			if (_currentLevel == 0) {
-				_res.load(lvl->name, Resource::OT_SGD);
+			if (_res.isPC98()) {
+				_res.PC98_loadLevelMap(_currentLevel);
 			}
-			_res.load(lvl->name, Resource::OT_LEV);
-		} else {
-			_res.load(lvl->name, Resource::OT_MAP);
 		}
-		_res.load(lvl->name2, Resource::OT_PGE);
-		if (!_res.isSega()) {
-			_res.load(lvl->name2, Resource::OT_OBJ);
-			_res.load(lvl->name2, Resource::OT_ANI);
-		}
-		_res.load(lvl->name2, Resource::OT_TBN);
 		break;
 	case kResourceTypeMac:
 		_res.MAC_unloadLevelData();
@@ -1785,6 +1821,8 @@ void Game::loadLevelData() {
 			}
 		}
 	}
+
+	stageNextLevelData();
 }
 
 void Game::drawIcon(uint8_t iconNum, int16_t x, int16_t y, uint8_t colMask) {
@@ -1847,8 +1885,10 @@ void Game::playSound(uint8_t num, uint8_t softVol) {
 	debug(DBG_GAME, "playSound num:%d volume:%d", num, softVol);
 	if (num < _res._numSfx) {
 		SoundFx *sfx = &_res._sfxList[num];
-		if (sfx->data) {
-			const int volume = Mixer::MAX_VOLUME >> (2 * softVol);
+		const int volume = Mixer::MAX_VOLUME >> (2 * softVol);
+		if (sfx->pcm) {
+			_mix.playPcm16(sfx->pcm, sfx->pcmLen, volume);
+		} else if (sfx->data) {
 			_mix.play(sfx->data, sfx->len, sfx->freq, volume);
 		}
 	} else if (num == 66) {
@@ -121,6 +121,8 @@ struct Game {
 	bool hasLevelRoom(int level, int room) const;
 	void loadLevelRoomHelper(int level, int room);
 	void loadLevelRoom();
+	int getLevelLoadJobs(int level, Resource::LoadJob *jobs, char *splName, int splNameSize) const;
+	void stageNextLevelData();
 	void loadLevelData();
 	void drawIcon(uint8_t iconNum, int16_t x, int16_t y, uint8_t colMask);
 	void drawCurrentInventoryItem();
@@ -24,6 +24,7 @@ void Graphics::drawPoint(uint8_t color, const Point *pt) {
 	debug(DBG_VIDEO, "Graphics::drawPoint() col=0x%X x=%d, y=%d", color, pt->x, pt->y);
 	if (pt->x >= 0 && pt->x < _crw && pt->y >= 0 && pt->y < _crh) {
 		*(_layer + (pt->y + _cry) * _layerPitch + pt->x + _crx) = color;
+		_dirtyRect.add(pt->x + _crx, pt->y + _cry, 1, 1);
 	}
 }
 
@@ -206,16 +207,23 @@ void Graphics::drawEllipse(uint8_t color, bool hasAlpha, const Point *pt, int16_
 void Graphics::fillArea(uint8_t color, bool hasAlpha) {
 	debug(DBG_VIDEO, "Graphics::fillArea()");
 	int16_t *pts = _areaPoints;
-	uint8_t *dst = _layer + (_cry + *pts++) * _layerPitch + _crx;
+	const int y = _cry + *pts++;
+	uint8_t *dst = _layer + y * _layerPitch + _crx;
 	int16_t x1 = *pts++;
 	if (x1 >= 0) {
+		int16_t xmin = x1;
+		int16_t xmax = -1;
+		int h = 0;
 		if (hasAlpha && color > 0xC7) {
 			do {
 				const int16_t x2 = MIN<int16_t>(_crw - 1, *pts++);
+				xmin = MIN(xmin, x1);
+				xmax = MAX(xmax, x2);
 				for (; x1 <= x2; ++x1) {
 					*(dst + x1) |= color & ~7;
 				}
 				dst += _layerPitch;
+				++h;
 				x1 = *pts++;
 			} while (x1 >= 0);
 		} else {
@@ -224,11 +232,15 @@ void Graphics::fillArea(uint8_t color, bool hasAlpha) {
 				if (x1 <= x2) {
 					const int len = x2 - x1 + 1;
 					memset(dst + x1, color, len);
+					xmin = MIN(xmin, x1);
+					xmax = MAX(xmax, x2);
 				}
 				dst += _layerPitch;
+				++h;
 				x1 = *pts++;
 			} while (x1 >= 0);
 		}
+		_dirtyRect.add(_crx + xmin, y, xmax - xmin + 1, h);
 	}
 }
 
@@ -747,6 +759,7 @@ void Graphics::floodFill(uint8_t color, const Point *pts, uint8_t numPts) {
 			ymin += _cry;
 			ymax += _cry;
 			_layer[(start_y + _cry) * _layerPitch + (start_x + _crx)] = color;
+			_dirtyRect.add(xmin, ymin, xmax - xmin + 1, ymax - ymin + 1);
 			while (r < w) {
 				const int x = _pointsQueue[r++];
 				const int y = _pointsQueue[r++];
@@ -9,12 +9,38 @@
 
 #include "intern.h"
 
+struct DirtyRect {
+	int x1, y1, x2, y2;
+
+	void reset() {
+		x1 = y1 = 0x7FFF;
+		x2 = y2 = -1;
+	}
+	bool isEmpty() const {
+		return x2 < x1 || y2 < y1;
+	}
+	void add(int x, int y, int w, int h) {
+		if (w > 0 && h > 0) {
+			x1 = MIN(x1, x);
+			y1 = MIN(y1, y);
+			x2 = MAX(x2, x + w - 1);
+			y2 = MAX(y2, y + h - 1);
+		}
+	}
+	void add(const DirtyRect &r) {
+		if (!r.isEmpty()) {
+			add(r.x1, r.y1, r.x2 - r.x1 + 1, r.y2 - r.y1 + 1);
+		}
+	}
+};
+
 struct Graphics {
 	static const int AREA_POINTS_SIZE = 256 * 2; // maxY * sizeof(Point) / sizeof(int16_t)
 	uint8_t *_layer;
 	int _layerPitch;
 	int16_t _areaPoints[AREA_POINTS_SIZE * 2];
 	int16_t _crx, _cry, _crw, _crh;
+	DirtyRect _dirtyRect; // area written to _layer
 
 	void setLayer(uint8_t *layer, int pitch);
 	void setClippingRect(int16_t vx, int16_t vy, int16_t vw, int16_t vh);
@@ -141,6 +141,11 @@ struct Options {
 	bool restore_memo_cutscene;
 	bool order_inventory_original;
 	bool fix_fmopl_e0_reg;
+	bool use_cutscene_cache;
+	bool use_music_cache;
+	bool use_files_index;
+	bool use_unpack_cache;
+	int music_lookahead; // ms of music decoded or synthesized ahead of the audio callback, 0 to do it in the callback
 };
 
 struct Features {
@@ -274,6 +279,8 @@ struct CollisionSlot {
 struct BankSlot {
 	uint16_t entryNum;
 	uint8_t *ptr;
+	int size;
+	uint32_t lastUse;
 };
 
 struct CollisionSlot2 {
@@ -295,6 +302,8 @@ struct SoundFx {
 	uint16_t freq;
 	uint8_t *data;
 	int8_t peak;
+	int16_t *pcm; // resampled to the mixer output rate
+	uint32_t pcmLen;
 };
 
 struct ResourceArchive {
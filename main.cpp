@@ -8,11 +8,13 @@
 #include <ctype.h>
 #include <getopt.h>
 #include <sys/stat.h>
+#include "audio_render.h"
 #include "file.h"
 #include "fs.h"
 #include "game.h"
 #include "scaler.h"
 #include "systemstub.h"
+#include "unpack_bench.h"
 #include "util.h"
 
 static const char *USAGE =
@@ -27,6 +29,13 @@ static const char *USAGE =
 	"  --language=LANG   Language (fr,en,de,sp,it,jp)\n"
 	"  --autosave        Save game state automatically\n"
 	"  --mididriver=MIDI Driver (adlib, mt32)\n"
+	"  --audiorate=HZ    Audio output sample rate (default 22050)\n"
+	"  --audiobuffer=NUM Audio buffer size in samples, lower values reduce latency (default 4096)\n"
+	"  --musiclookahead=MS Music decoded or synthesized ahead, 0 to disable (default 250)\n"
+	"  --rendermusic=NUM Write music NUM to a WAV file and exit, without audio device\n"
+	"  --renderfile=FILE WAV file for --rendermusic (default 'music.wav')\n"
+	"  --renderduration=SECONDS Duration for --rendermusic (default 60)\n"
+	"  --benchunpack     Compare the bytekiller decoders on the data files and exit\n"
 ;
 
 static const Features kFeaturesAmiga     = { false /* extended_intro */, true  /* bigendian */, 1, true  /* copy_protection */ };
@@ -118,6 +127,10 @@ static void initOptions() {
 	g_options.restore_memo_cutscene = true;
 	g_options.order_inventory_original = false;
 	g_options.fix_fmopl_e0_reg = false;
+	g_options.use_cutscene_cache = false;
+	g_options.use_music_cache = false;
+	g_options.use_files_index = false;
+	g_options.use_unpack_cache = false;
 	// read configuration file
 	struct {
 		const char *name;
@@ -142,6 +155,10 @@ static void initOptions() {
 		{ "restore_memo_cutscene", &g_options.restore_memo_cutscene },
 		{ "order_inventory_original", &g_options.order_inventory_original },
 		{ "fix_fmopl_e0_reg", &g_options.fix_fmopl_e0_reg },
+		{ "use_cutscene_cache", &g_options.use_cutscene_cache },
+		{ "use_music_cache", &g_options.use_music_cache },
+		{ "use_files_index", &g_options.use_files_index },
+		{ "use_unpack_cache", &g_options.use_unpack_cache },
 		{ 0, 0 }
 	};
 	static const char *filename = "rs.cfg";
@@ -218,6 +235,13 @@ int main(int argc, char *argv[]) {
 	uint32_t cheats = 0;
 	WidescreenMode widescreen = kWidescreenNone;
 	ScalerParameters scalerParameters = ScalerParameters::defaults();
+	AudioParameters audioParameters = AudioParameters::defaults();
+	AudioRenderParameters renderParameters;
+	renderParameters.music = 0;
+	renderParameters.duration = 60;
+	renderParameters.filename = "music.wav";
+	bool benchUnpackData = false;
+	int musicLookahead = 250;
 	int forcedLanguage = -1;
 	int midiDriver = MODE_ADLIB;
 	g_debugMask = 0; // DBG_CUT | DBG_VIDEO | DBG_RES | DBG_MENU | DBG_PGE | DBG_GAME | DBG_UNPACK | DBG_COL | DBG_MOD | DBG_SFX | DBG_FILE;
@@ -242,6 +266,13 @@ int main(int argc, char *argv[]) {
 			{ "mididriver", required_argument, 0, 10 },
 			{ "debug",      required_argument, 0, 11 },
 			{ "maximized",  no_argument,       0, 12 },
+			{ "audiorate",  required_argument, 0, 13 },
+			{ "audiobuffer", required_argument, 0, 14 },
+			{ "musiclookahead", required_argument, 0, 15 },
+			{ "rendermusic", required_argument, 0, 16 },
+			{ "renderfile", required_argument, 0, 17 },
+			{ "renderduration", required_argument, 0, 18 },
+			{ "benchunpack", no_argument,      0, 19 },
 			{ 0, 0, 0, 0 }
 		};
 		int index;
@@ -326,23 +357,62 @@ int main(int argc, char *argv[]) {
 		case 12:
 			maximizedWindow = true;
 			break;
+		case 13:
+			audioParameters.sampleRate = atoi(optarg);
+			if (audioParameters.sampleRate < 8000 || audioParameters.sampleRate > 48000) {
+				warning("Invalid audio sample rate %d", audioParameters.sampleRate);
+				audioParameters.sampleRate = AudioParameters::defaults().sampleRate;
+			}
+			break;
+		case 14:
+			audioParameters.bufferSize = atoi(optarg);
+			if (audioParameters.bufferSize < 64 || audioParameters.bufferSize > 8192) {
+				warning("Invalid audio buffer size %d", audioParameters.bufferSize);
+				audioParameters.bufferSize = AudioParameters::defaults().bufferSize;
+			}
+			break;
+		case 15:
+			musicLookahead = CLIP(atoi(optarg), 0, 2000);
+			break;
+		case 16:
+			renderParameters.music = atoi(optarg);
+			break;
+		case 17:
+			renderParameters.filename = strdup(optarg);
+			break;
+		case 18:
+			renderParameters.duration = CLIP(atoi(optarg), 1, 3600);
+			break;
+		case 19:
+			benchUnpackData = true;
+			break;
 		default:
 			printf(USAGE, argv[0]);
 			return 0;
 		}
 	}
 	initOptions();
-	FileSystem fs(dataPath);
+	g_options.music_lookahead = musicLookahead;
+	FileSystem fs(dataPath, g_options.use_files_index ? savePath : 0);
 	const int version = detectVersion(&fs);
 	if (version == -1) {
 		error("Unable to find data files, check that all required files are present");
 		return -1;
 	}
 	assert(g_features);
+	if (renderParameters.music != 0) {
+		// mix in the calling thread and synthesize the music, the output only depends on the data files
+		g_options.music_lookahead = 0;
+		g_options.use_music_cache = false;
+		return renderAudio(&fs, (ResourceType)version, midiDriver, &audioParameters, &renderParameters) ? 0 : -1;
+	}
+	if (benchUnpackData) {
+		return benchUnpack(&fs, (ResourceType)version) ? 0 : -1;
+	}
 	const Language language = (forcedLanguage == -1) ? detectLanguage(&fs) : (Language)forcedLanguage;
 	SystemStub *stub = SystemStub_SDL_create();
 	Game *g = new Game(stub, &fs, savePath, levelNum, (ResourceType)version, language, widescreen, autoSave, midiDriver, cheats);
-	stub->init(g_caption, g->_vid._w, g->_vid._h, fullscreen, widescreen, maximizedWindow, &scalerParameters);
+	stub->init(g_caption, g->_vid._w, g->_vid._h, fullscreen, widescreen, maximizedWindow, &scalerParameters, &audioParameters);
 	g->run();
 	delete g;
 	stub->destroy();
@@ -4,19 +4,25 @@
  * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "mixer.h"
 #include "systemstub.h"
 #include "util.h"
 
 Mixer::Mixer(FileSystem *fs, SystemStub *stub, int midiDriver)
-	: _stub(stub), _musicType(MT_NONE), _cpc(this, fs), _mod(this, fs), _ogg(this, fs), _prf(this, fs, midiDriver), _sfx(this) {
+	: _stub(stub), _musicType(MT_NONE), _cpc(this, fs), _mod(this, fs), _ogg(this, fs), _prf(this, fs, midiDriver), _sfx(this), _musicCache(this) {
 	_musicTrack = -1;
 	_backgroundMusicType = MT_NONE;
 }
 
 void Mixer::init() {
 	for (int i = 0; i < NUM_CHANNELS; ++i) {
-		_channels[i].active = false;
+		setChannelActive(i, false);
+	}
+	if (!_commands.init(MAX_COMMANDS)) {
+		error("Unable to allocate mixer command queue");
 	}
 	_premixHook = 0;
 	_stub->startAudio(Mixer::mixCallback, this);
@@ -24,12 +30,14 @@ void Mixer::init() {
 
 void Mixer::free() {
 	setPremixHook(0, 0);
+	_musicCache.stopBuilding();
 	stopAll();
 	_stub->stopAudio();
 }
 
 void Mixer::setPremixHook(PremixHook premixHook, void *userData) {
 	debug(DBG_SND, "Mixer::setPremixHook()");
+	// the callers release the hook data on return, this can not be deferred to the audio thread
 	LockAudioStack las(_stub);
 	_premixHook = premixHook;
 	_premixHookData = userData;
@@ -37,35 +45,37 @@ void Mixer::setPremixHook(PremixHook premixHook, void *userData) {
 
 void Mixer::play(const uint8_t *data, uint32_t len, uint16_t freq, uint8_t volume) {
 	debug(DBG_SND, "Mixer::play(%d, %d)", freq, volume);
-	LockAudioStack las(_stub);
-	for (int i = 0; i < NUM_CHANNELS; ++i) {
-		MixerChannel *ch = &_channels[i];
-		if (ch->active && ch->soundData == data) { // repeat sound
-			ch->soundPos = 0;
-			ch->volume = volume;
-			return;
-		}
-	}
-	for (int i = 0; i < NUM_CHANNELS; ++i) {
-		MixerChannel *ch = &_channels[i];
-		if (!ch->active) { // start sound
-			ch->active = true;
-			ch->volume = volume;
-			ch->soundData = data;
-			ch->soundSize = len;
-			ch->soundPos = 0;
-			ch->soundInc = (freq << FRAC_BITS) / _stub->getOutputSampleRate();
-			return;
-		}
-	}
+	MixerCommand cmd;
+	cmd.type = MixerCommand::kPlay;
+	cmd.data = data;
+	cmd.len = len;
+	cmd.inc = (freq << FRAC_BITS) / _stub->getOutputSampleRate();
+	cmd.volume = volume;
+	cmd.bits = 8;
+	queueCommand(cmd);
+}
+
+// samples are already at the output rate
+void Mixer::playPcm16(const int16_t *data, uint32_t len, uint8_t volume) {
+	debug(DBG_SND, "Mixer::playPcm16(%d, %d)", len, volume);
+	MixerCommand cmd;
+	cmd.type = MixerCommand::kPlay;
+	cmd.data = (const uint8_t *)data;
+	cmd.len = len;
+	cmd.inc = 1 << FRAC_BITS;
+	cmd.volume = volume;
+	cmd.bits = 16;
+	queueCommand(cmd);
 }
 
 bool Mixer::isPlaying(const uint8_t *data) const {
 	debug(DBG_SND, "Mixer::isPlaying");
-	LockAudioStack las(_stub);
+	// check the pending commands first, the channels are updated before a command is dequeued
+	if (_commands.findQueued([data](const MixerCommand &cmd) { return cmd.type == MixerCommand::kPlay && cmd.data == data; })) {
+		return true;
+	}
 	for (int i = 0; i < NUM_CHANNELS; ++i) {
-		const MixerChannel *ch = &_channels[i];
-		if (ch->active && ch->soundData == data) {
+		if (_channelsData[i].load(std::memory_order_acquire) == data) {
 			return true;
 		}
 	}
@@ -78,9 +88,64 @@ uint32_t Mixer::getSampleRate() const {
 
 void Mixer::stopAll() {
 	debug(DBG_SND, "Mixer::stopAll()");
+	MixerCommand cmd;
+	cmd.type = MixerCommand::kStopAll;
+	cmd.data = 0;
+	queueCommand(cmd);
+	// the sound data can be freed once this returns, wait for the queue to be flushed
 	LockAudioStack las(_stub);
-	for (uint8_t i = 0; i < NUM_CHANNELS; ++i) {
-		_channels[i].active = false;
+	processCommands();
+}
+
+void Mixer::queueCommand(const MixerCommand &cmd) {
+	if (_commands.write(&cmd, 1) != 1) {
+		debug(DBG_SND, "Mixer command queue is full, dropping command %d", cmd.type);
+	}
+}
+
+void Mixer::setChannelActive(int i, bool active) {
+	MixerChannel *ch = &_channels[i];
+	ch->active = active;
+	_channelsData[i].store(active ? ch->soundData : 0, std::memory_order_release);
+}
+
+void Mixer::processCommands() {
+	const MixerCommand *cmd;
+	while ((cmd = _commands.front()) != 0) {
+		switch (cmd->type) {
+		case MixerCommand::kPlay: {
+				int channel = -1;
+				for (int i = 0; i < NUM_CHANNELS; ++i) {
+					MixerChannel *ch = &_channels[i];
+					if (ch->active && ch->soundData == cmd->data) { // repeat sound
+						ch->soundPos = 0;
+						ch->volume = cmd->volume;
+						channel = -1;
+						break;
+					}
+					if (!ch->active && channel == -1) {
+						channel = i;
+					}
+				}
+				if (channel != -1) { // start sound
+					MixerChannel *ch = &_channels[channel];
+					ch->volume = cmd->volume;
+					ch->soundData = cmd->data;
+					ch->soundSize = cmd->len;
+					ch->soundPos = 0;
+					ch->soundInc = cmd->inc;
+					ch->bits = cmd->bits;
+					setChannelActive(channel, true);
+				}
+			}
+			break;
+		case MixerCommand::kStopAll:
+			for (int i = 0; i < NUM_CHANNELS; ++i) {
+				setChannelActive(i, false);
+			}
+			break;
+		}
+		_commands.pop();
 	}
 }
 
@@ -172,30 +237,97 @@ void Mixer::stopMusic() {
 	}
 }
 
+// number of output samples the channel can produce before reaching the end of its data
+static int getChannelSamples(const MixerChannel *ch, int len) {
+	const uint64_t end = uint64_t(ch->soundSize) << Mixer::FRAC_BITS;
+	if (ch->soundPos >= end) {
+		return 0;
+	}
+	if (ch->soundInc == 0) {
+		return len;
+	}
+	const uint64_t count = (end - ch->soundPos + ch->soundInc - 1) / ch->soundInc;
+	return (count < uint64_t(len)) ? int(count) : len;
+}
+
+static void mixChannel16(MixerChannel *ch, int32_t *acc, int len) {
+	const int16_t *data = (const int16_t *)ch->soundData + (ch->soundPos >> Mixer::FRAC_BITS);
+	const int volume = ch->volume;
+	for (int i = 0; i < len; ++i) {
+		acc[i] += data[i] * volume / Mixer::MAX_VOLUME;
+	}
+	ch->soundPos += len << Mixer::FRAC_BITS;
+}
+
+static void mixChannel(MixerChannel *ch, int32_t *acc, int len) {
+	if (ch->bits == 16) {
+		mixChannel16(ch, acc, len);
+		return;
+	}
+	const uint8_t *data = ch->soundData;
+	const int volume = ch->volume;
+	const uint32_t inc = ch->soundInc;
+	uint32_t pos = ch->soundPos;
+	for (int i = 0; i < len; ++i) {
+		acc[i] += S8_to_S16(data[pos >> Mixer::FRAC_BITS]) * volume / Mixer::MAX_VOLUME;
+		pos += inc;
+	}
+	ch->soundPos = pos;
+}
+
+// adds the mono accumulator to both channels of the output, saturating to 16 bits
+void Mixer::packSamples(int16_t *out, const int32_t *acc, int len) {
+	int i = 0;
+#ifdef __SSE2__
+	for (; i + 4 <= len; i += 4) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+		const __m128i o = _mm_loadu_si128((const __m128i *)(out + 2 * i));
+		const __m128i lo = _mm_add_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(o, o), 16), _mm_unpacklo_epi32(a, a));
+		const __m128i hi = _mm_add_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(o, o), 16), _mm_unpackhi_epi32(a, a));
+		_mm_storeu_si128((__m128i *)(out + 2 * i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+	for (; i < len; ++i) {
+		out[2 * i]     = ADDC_S16(out[2 * i],     acc[i]);
+		out[2 * i + 1] = ADDC_S16(out[2 * i + 1], acc[i]);
+	}
+}
+
 void Mixer::mix(int16_t *out, int len) {
+	processCommands();
+	uint64_t timeStamp = AudioStats::getTimeUs();
 	if (_premixHook) {
 		if (!_premixHook(_premixHookData, out, len)) {
 			_premixHook = 0;
 			_premixHookData = 0;
 		}
+		const uint64_t premixTimeStamp = AudioStats::getTimeUs();
+		_stub->_audioStats._premix.add((uint32_t)(premixTimeStamp - timeStamp));
+		timeStamp = premixTimeStamp;
 	}
-	for (uint8_t i = 0; i < NUM_CHANNELS; ++i) {
-		MixerChannel *ch = &_channels[i];
-		if (ch->active) {
-			for (int pos = 0; pos < len; ++pos) {
-				const uint32_t sPos = ch->soundPos >> FRAC_BITS;
-				if (sPos >= ch->soundSize) {
-					ch->active = false;
-					break;
+	for (int offset = 0; offset < len; offset += MIX_BLOCK_SIZE) {
+		const int count = MIN(len - offset, (int)MIX_BLOCK_SIZE);
+		bool mixed = false;
+		for (int i = 0; i < NUM_CHANNELS; ++i) {
+			MixerChannel *ch = &_channels[i];
+			if (ch->active) {
+				const int samples = getChannelSamples(ch, count);
+				if (!mixed) {
+					memset(_mixBuf, 0, sizeof(int32_t) * count);
+					mixed = true;
+				}
+				mixChannel(ch, _mixBuf, samples);
+				if (samples < count) {
+					setChannelActive(i, false);
 				}
-				const int8_t s8 = ch->soundData[sPos];
-				const int sample = S8_to_S16(s8) * ch->volume / Mixer::MAX_VOLUME;
-				out[2 * pos]     = ADDC_S16(out[2 * pos],     sample);
-				out[2 * pos + 1] = ADDC_S16(out[2 * pos + 1], sample);
-				ch->soundPos += ch->soundInc;
 			}
 		}
+		if (!mixed) {
+			break;
+		}
+		packSamples(out + 2 * offset, _mixBuf, count);
 	}
+	_stub->_audioStats._channels.add((uint32_t)(AudioStats::getTimeUs() - timeStamp));
 }
 
 void Mixer::mixCallback(void *param, int16_t *buf, int len) {
@@ -7,22 +7,39 @@
 #ifndef MIXER_H__
 #define MIXER_H__
 
+#include <atomic>
 #include "intern.h"
 #include "cpc_player.h"
 #include "mod_player.h"
+#include "music_cache.h"
 #include "ogg_player.h"
 #include "prf_player.h"
+#include "ring_buffer.h"
 #include "sfx_player.h"
 
 struct MixerChannel {
 	uint8_t active;
 	uint8_t volume;
+	uint8_t bits;
 	const uint8_t *soundData;
 	uint32_t soundSize;
 	uint32_t soundPos;
 	uint32_t soundInc;
 };
 
+struct MixerCommand {
+	enum {
+		kPlay,
+		kStopAll
+	};
+	int type;
+	const uint8_t *data;
+	uint32_t len;
+	uint32_t inc;
+	uint8_t volume;
+	uint8_t bits;
+};
+
 struct FileSystem;
 struct SystemStub;
 
@@ -42,12 +59,16 @@ struct Mixer {
 		MUSIC_TRACK = 1000,
 		NUM_CHANNELS = 4,
 		FRAC_BITS = 12,
-		MAX_VOLUME = 64
+		MAX_VOLUME = 64,
+		MIX_BLOCK_SIZE = 512,
+		MAX_COMMANDS = 64
 	};
 
 	FileSystem *_fs;
 	SystemStub *_stub;
 	MixerChannel _channels[NUM_CHANNELS];
+	std::atomic<const uint8_t *> _channelsData[NUM_CHANNELS]; // published by the audio thread
+	RingBuffer<MixerCommand> _commands; // written by the game thread, read by the audio thread
 	PremixHook _premixHook;
 	void *_premixHookData;
 	MusicType _backgroundMusicType;
@@ -57,20 +78,27 @@ struct Mixer {
 	OggPlayer _ogg;
 	PrfPlayer _prf;
 	SfxPlayer _sfx;
+	MusicCache _musicCache;
 	int _musicTrack;
+	int32_t _mixBuf[MIX_BLOCK_SIZE];
 
 	Mixer(FileSystem *fs, SystemStub *stub, int midiDriver);
 	void init();
 	void free();
 	void setPremixHook(PremixHook premixHook, void *userData);
 	void play(const uint8_t *data, uint32_t len, uint16_t freq, uint8_t volume);
+	void playPcm16(const int16_t *data, uint32_t len, uint8_t volume);
 	bool isPlaying(const uint8_t *data) const;
 	uint32_t getSampleRate() const;
 	void stopAll();
+	void queueCommand(const MixerCommand &cmd);
+	void processCommands();
+	void setChannelActive(int i, bool active);
 	void playMusic(int num, int tempo = 0);
 	void stopMusic();
 	void mix(int16_t *buf, int len);
 
+	static void packSamples(int16_t *out, const int32_t *acc, int len);
 	static void mixCallback(void *param, int16_t *buf, int len);
 };
 
@@ -4,6 +4,7 @@
  * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
+#include <mutex>
 #include "file.h"
 #include "mixer.h"
 #include "mod_player.h"
@@ -53,14 +54,18 @@ struct ModPlayer_impl {
 		}
 	}
 
+	int read(int16_t *buf, int len) {
+		const int order = ModPlug_GetCurrentOrder(_mf);
+		if (order == 3 && _repeatIntro) {
+			ModPlug_SeekOrder(_mf, 1);
+			_repeatIntro = false;
+		}
+		return ModPlug_Read(_mf, buf, len * sizeof(int16_t) * 2);
+	}
+
 	bool mix(int16_t *buf, int len) {
 		if (_mf) {
-			const int order = ModPlug_GetCurrentOrder(_mf);
-			if (order == 3 && _repeatIntro) {
-				ModPlug_SeekOrder(_mf, 1);
-				_repeatIntro = false;
-			}
-			const int count = ModPlug_Read(_mf, buf, len * sizeof(int16_t) * 2);
+			const int count = read(buf, len);
 			// setting mLoopCount to non-zero does not trigger any looping in
 			// my test and ModPlug_Read returns 0.
 			// looking at the libmodplug-0.8.8 tarball, it seems the variable
@@ -84,7 +89,9 @@ struct ModPlayer_impl {
 		NUM_PATTERNS = 128,
 		FRAC_BITS = 12,
 		BASE_TEMPO = 125,
-		PAULA_FREQ = 3546897
+		PAULA_FREQ = 3546897,
+		MIX_BLOCK_SIZE = 512,
+		MAX_VOLUME = 64
 	};
 
 	struct SampleInfo {
@@ -145,10 +152,17 @@ struct ModPlayer_impl {
 	int _patternLoopCount;
 	int _samplesLeft;
 	bool _repeatIntro;
+	bool _looped;
 	Track _tracks[NUM_TRACKS];
+	int32_t _mixBuf[MIX_BLOCK_SIZE];
+
+	static int16_t _volumeTable[MAX_VOLUME + 1][256];
+	static std::once_flag _volumeTableInit;
 
 	ModPlayer_impl();
 
+	static void initVolumeTable();
+
 	void init(const int rate);
 	uint16_t findPeriod(uint16_t period, uint8_t fineTune) const;
 	bool load(File *f);
@@ -159,12 +173,17 @@ struct ModPlayer_impl {
 	void applyVibrato(int trackNum);
 	void applyPortamento(int trackNum);
 	void handleEffect(int trackNum, bool tick);
+	void mixTrack(Track *tk, int32_t *acc, int len);
 	void mixSamples(int16_t *buf, int len);
+	int render(int16_t *buf, int len);
 	bool mix(int16_t *buf, int len);
 };
 
+int16_t ModPlayer_impl::_volumeTable[MAX_VOLUME + 1][256];
+std::once_flag ModPlayer_impl::_volumeTableInit;
+
 ModPlayer_impl::ModPlayer_impl()
-	: _playing(false) {
+	: _playing(false), _looped(false) {
 	memset(&_modInfo, 0, sizeof(_modInfo));
 }
 
@@ -178,8 +197,18 @@ uint16_t ModPlayer_impl::findPeriod(uint16_t period, uint8_t fineTune) const {
 	return 0;
 }
 
+// the table is shared by the player and the music cache renderer, it is built once and then only read
+void ModPlayer_impl::initVolumeTable() {
+	for (int vol = 0; vol <= MAX_VOLUME; ++vol) {
+		for (int i = 0; i < 256; ++i) {
+			_volumeTable[vol][i] = S8_to_S16(i) * vol / MAX_VOLUME;
+		}
+	}
+}
+
 void ModPlayer_impl::init(const int rate) {
 	_mixingRate = rate;
+	std::call_once(_volumeTableInit, initVolumeTable);
 }
 
 bool ModPlayer_impl::load(File *f) {
@@ -241,6 +270,7 @@ bool ModPlayer_impl::load(File *f) {
 	_patternLoopCount = -1;
 	_samplesLeft = 0;
 	_repeatIntro = false;
+	_looped = false;
 	memset(_tracks, 0, sizeof(_tracks));
 	_playing = true;
 
@@ -587,51 +617,100 @@ void ModPlayer_impl::handleTick() {
 		debug(DBG_MOD, "ModPlayer::handleEffect() _currentPatternOrder == _modInfo.numPatterns");
 //		_playing = false;
 		_currentPatternOrder = 0;
+		_looped = true;
+	}
+}
+
+// the runs end before the sample (or loop) end, the PCM data is fetched without clamping
+void ModPlayer_impl::mixTrack(Track *tk, int32_t *acc, int samplesLen) {
+	const SampleInfo *si = tk->sample;
+	const int16_t *volumeTable = _volumeTable[MIN((int)tk->volume, (int)MAX_VOLUME)];
+	const int len = si->len << FRAC_BITS;
+	const int loopLen = si->repeatLen << FRAC_BITS;
+	const int loopPos = si->repeatPos << FRAC_BITS;
+	const int deltaPos = (tk->freq << FRAC_BITS) / _mixingRate;
+	// some modules have the loop ending past the sample data
+	const bool clampPCM = (loopLen > (2 << FRAC_BITS)) && (loopPos + loopLen > len);
+	int pos = tk->pos;
+	while (samplesLen != 0) {
+		int count;
+		if (loopLen > (2 << FRAC_BITS)) {
+			if (pos >= loopPos + loopLen) {
+				pos -= loopLen;
+			}
+			count = MIN(samplesLen, (loopPos + loopLen - pos - 1) / deltaPos + 1);
+			samplesLen -= count;
+		} else {
+			if (pos >= len) {
+				count = 0;
+			} else {
+				count = MIN(samplesLen, (len - pos - 1) / deltaPos + 1);
+			}
+			samplesLen = 0;
+		}
+		if (clampPCM) {
+			for (int i = 0; i < count; ++i) {
+				acc[i] += volumeTable[(uint8_t)si->getPCM(pos >> FRAC_BITS)];
+				pos += deltaPos;
+			}
+		} else {
+			const int8_t *data = si->data;
+			for (int i = 0; i < count; ++i) {
+				acc[i] += volumeTable[(uint8_t)data[pos >> FRAC_BITS]];
+				pos += deltaPos;
+			}
+		}
+		acc += count;
 	}
+	tk->pos = pos;
 }
 
 void ModPlayer_impl::mixSamples(int16_t *buf, int samplesLen) {
-	for (int i = 0; i < NUM_TRACKS; ++i) {
-		Track *tk = &_tracks[i];
-		if (tk->sample != 0 && tk->delayCounter == 0) {
-			int16_t *mixbuf = buf;
-			SampleInfo *si = tk->sample;
-			int len = si->len << FRAC_BITS;
-			int loopLen = si->repeatLen << FRAC_BITS;
-			int loopPos = si->repeatPos << FRAC_BITS;
-			int deltaPos = (tk->freq << FRAC_BITS) / _mixingRate;
-			int curLen = samplesLen;
-			int pos = tk->pos;
-			while (curLen != 0) {
-				int count;
-				if (loopLen > (2 << FRAC_BITS)) {
-					if (pos >= loopPos + loopLen) {
-						pos -= loopLen;
-					}
-					count = MIN(curLen, (loopPos + loopLen - pos - 1) / deltaPos + 1);
-					curLen -= count;
-				} else {
-					if (pos >= len) {
-						count = 0;
-					} else {
-						count = MIN(curLen, (len - pos - 1) / deltaPos + 1);
-					}
-					curLen = 0;
-				}
-				while (count--) {
-					const int sample = S8_to_S16(si->getPCM(pos >> FRAC_BITS)) * tk->volume / 64;
-					*mixbuf = ADDC_S16(*mixbuf, sample);
-					++mixbuf;
-					*mixbuf = ADDC_S16(*mixbuf, sample);
-					++mixbuf;
-					pos += deltaPos;
+	while (samplesLen != 0) {
+		const int count = MIN(samplesLen, (int)MIX_BLOCK_SIZE);
+		bool mixed = false;
+		for (int i = 0; i < NUM_TRACKS; ++i) {
+			Track *tk = &_tracks[i];
+			if (tk->sample != 0 && tk->delayCounter == 0) {
+				if (!mixed) {
+					memset(_mixBuf, 0, sizeof(int32_t) * count);
+					mixed = true;
 				}
+				mixTrack(tk, _mixBuf, count);
 			}
-			tk->pos = pos;
 		}
+		if (mixed) {
+			Mixer::packSamples(buf, _mixBuf, count);
+		}
+		buf += count * 2; // stereo
+		samplesLen -= count;
 	}
 }
 
+// mixes until the song loops back to the first pattern
+int ModPlayer_impl::render(int16_t *buf, int len) {
+	if (!_playing) {
+		return -1;
+	}
+	memset(buf, 0, sizeof(int16_t) * len * 2); // stereo
+	const int samplesPerTick = _mixingRate / (50 * _songTempo / BASE_TEMPO);
+	int total = 0;
+	while (total < len) {
+		if (_samplesLeft == 0) {
+			if (_looped && _currentTick == 0) {
+				break;
+			}
+			handleTick();
+			_samplesLeft = samplesPerTick;
+		}
+		const int count = MIN(_samplesLeft, len - total);
+		_samplesLeft -= count;
+		mixSamples(buf + total * 2, count);
+		total += count;
+	}
+	return total;
+}
+
 bool ModPlayer_impl::mix(int16_t *buf, int len) {
 	memset(buf, 0, sizeof(int16_t) * len * 2); // stereo
 	if (_playing) {
@@ -664,16 +743,51 @@ ModPlayer::~ModPlayer() {
 	delete _impl;
 }
 
+static bool openModule(File &f, int num, FileSystem *fs) {
+	if (!f.open(ModPlayer::_names[num * 2], "rb", fs)) {
+		const char *p = ModPlayer::_names[num * 2 + 1];
+		char name[32];
+		snprintf(name, sizeof(name), "mod.flashback-%s", p ? p : ModPlayer::_names[num * 2]);
+		if (!f.open(name, "rb", fs)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+#ifndef USE_MODPLUG
+struct ModRenderer : MusicRenderer {
+	ModPlayer_impl _impl;
+
+	virtual ~ModRenderer() {
+		_impl.unload();
+	}
+	virtual int render(int16_t *buf, int len) {
+		return _impl.render(buf, len);
+	}
+};
+#endif
+
 void ModPlayer::play(int num, int tempo) {
 	if (num * 2 < _namesCount) {
+#ifndef USE_MODPLUG
+		// libmodplug keeps its mixer settings and buffers in globals, a second module can not be rendered while this one plays
+		MusicCache::Key key;
+		key.type = MusicCacheKey::kTypeMod;
+		key.num = num;
+		key.tempo = tempo;
+		key.mode = _isAmiga ? 1 : 0;
+		key.flags = 0;
+		key.backend = MusicCacheKey::kBackendInternal;
+		key.rate = _mix->getSampleRate();
+		if (g_options.use_music_cache && _mix->_musicCache.play(key)) {
+			_playing = true;
+			return;
+		}
+#endif
 		File f;
-		if (!f.open(_names[num * 2], "rb", _fs)) {
-			const char *p = _names[num * 2 + 1];
-			char name[32];
-			snprintf(name, sizeof(name), "mod.flashback-%s", p ? p : _names[num * 2]);
-			if (!f.open(name, "rb", _fs)) {
-				return;
-			}
+		if (!openModule(f, num, _fs)) {
+			return;
 		}
 		_impl->init(_mix->getSampleRate());
 		if (_impl->load(&f)) {
@@ -681,6 +795,20 @@ void ModPlayer::play(int num, int tempo) {
 			_impl->_repeatIntro = (num == 0) && !_isAmiga;
 			_mix->setPremixHook(mixCallback, _impl);
 			_playing = true;
+#ifndef USE_MODPLUG
+			if (g_options.use_music_cache) {
+				// render the module a second time in the background for the next plays
+				ModRenderer *renderer = new ModRenderer;
+				renderer->_impl.init(_mix->getSampleRate());
+				if (openModule(f, num, _fs) && renderer->_impl.load(&f)) {
+					renderer->_impl._songTempo = tempo;
+					renderer->_impl._repeatIntro = _impl->_repeatIntro;
+					_mix->_musicCache.build(key, renderer);
+				} else {
+					delete renderer;
+				}
+			}
+#endif
 		}
 	}
 }
@@ -689,6 +817,7 @@ void ModPlayer::stop() {
 	if (_playing) {
 		_mix->setPremixHook(0, 0);
 		_impl->unload();
+		_mix->_musicCache.unload();
 		_playing = false;
 	}
 }
@@ -0,0 +1,262 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <sys/param.h>
+#include "file.h"
+#include "mixer.h"
+#include "music_cache.h"
+#include "util.h"
+
+static const uint32_t TAG = 0x46424D43; // 'FBMC'
+static const uint16_t kCacheVersion = 2;
+
+static const int kChunkSize = 2048; // stereo samples
+static const int kMaxDuration = 10 * 60; // seconds
+
+// the file name includes a hash of the key, the tracks synthesized with other settings get their own file
+static void getCacheName(char *name, int size, const MusicCacheKey &key) {
+	uint32_t hash = hashData(&key.type, sizeof(key.type));
+	hash = hashData(&key.num, sizeof(key.num), hash);
+	hash = hashData((const uint8_t *)&key.tempo, sizeof(key.tempo), hash);
+	hash = hashData(&key.mode, sizeof(key.mode), hash);
+	hash = hashData(&key.flags, sizeof(key.flags), hash);
+	hash = hashData(&key.backend, sizeof(key.backend), hash);
+	hash = hashData((const uint8_t *)&key.rate, sizeof(key.rate), hash);
+	snprintf(name, size, "rs-music-%s%02d-%08x.cache", (key.type == MusicCacheKey::kTypeMod) ? "mod" : "prf", key.num, hash);
+}
+
+static void writeKey(File &f, const MusicCacheKey &key) {
+	f.writeUint32BE(TAG);
+	f.writeUint16BE(kCacheVersion);
+	f.writeByte(key.type);
+	f.writeByte(key.num);
+	f.writeUint16BE(key.tempo);
+	f.writeByte(key.mode);
+	f.writeByte(key.flags);
+	f.writeByte(key.backend);
+	f.writeUint32BE(key.rate);
+}
+
+static bool checkKey(File &f, const MusicCacheKey &key) {
+	if (f.readUint32BE() != TAG || f.readUint16BE() != kCacheVersion) {
+		return false;
+	}
+	MusicCacheKey k;
+	k.type = f.readByte();
+	k.num = f.readByte();
+	k.tempo = f.readUint16BE();
+	k.mode = f.readByte();
+	k.flags = f.readByte();
+	k.backend = f.readByte();
+	k.rate = f.readUint32BE();
+	if (f.ioErr()) {
+		return false;
+	}
+	return k.type == key.type && k.num == key.num && k.tempo == key.tempo && k.mode == key.mode && k.flags == key.flags && k.backend == key.backend && k.rate == key.rate;
+}
+
+MusicCache::MusicCache(Mixer *mix)
+	: _directory(0), _mix(mix), _dataPos(0), _chunkLeft(0), _playing(false), _buildStop(false), _buildRunning(false) {
+	_name[0] = 0;
+}
+
+MusicCache::~MusicCache() {
+	stopBuilding();
+	unload();
+}
+
+bool MusicCache::play(const Key &key) {
+	if (!_directory) {
+		return false;
+	}
+	if (_playing) {
+		_mix->setPremixHook(0, 0);
+		unload();
+	}
+	getCacheName(_name, sizeof(_name), key);
+	if (!_f.open(_name, "zrb", _directory) || !checkKey(_f, key)) {
+		_f.close();
+		return false;
+	}
+	// samples are stored as chunks of stereo 16 bits little endian samples, a zero count ends the file
+	_dataPos = _f.tell();
+	_chunkLeft = _f.readUint16BE();
+	if (_f.ioErr() || _chunkLeft == 0 || _chunkLeft > kChunkSize) {
+		warning("Invalid music cache file '%s'", _name);
+		_f.close();
+		return false;
+	}
+	debug(DBG_SND, "Playing music from cache '%s'", _name);
+	_playing = true;
+	_stream.start(_mix->getSampleRate(), readSamplesProc, this);
+	_mix->setPremixHook(mixCallback, this);
+	return true;
+}
+
+void MusicCache::unload() {
+	_stream.stop();
+	_f.close();
+	_playing = false;
+}
+
+void MusicCache::build(const Key &key, MusicRenderer *renderer) {
+	if (_buildThread.joinable() && !_buildRunning) {
+		_buildThread.join();
+	}
+	if (!_directory || _buildThread.joinable()) {
+		// one track at a time, it will be cached the next time it is played
+		delete renderer;
+		return;
+	}
+	_buildStop = false;
+	_buildRunning = true;
+	_buildThread = std::thread(&MusicCache::buildFile, this, key, renderer);
+}
+
+void MusicCache::stopBuilding() {
+	if (_buildThread.joinable()) {
+		_buildStop = true;
+		_buildThread.join();
+	}
+}
+
+void MusicCache::buildFile(Key key, MusicRenderer *renderer) {
+	MusicCacheFile f;
+	if (f.open(_directory, key)) {
+		int16_t buf[kChunkSize * 2];
+		bool complete = false;
+		while (!_buildStop && f._open) {
+			const int count = renderer->render(buf, kChunkSize);
+			if (count <= 0) {
+				complete = (count == 0);
+				break;
+			}
+			f.write(buf, count);
+		}
+		f.close(complete);
+	}
+	delete renderer;
+	_buildRunning = false;
+}
+
+MusicCacheFile::MusicCacheFile()
+	: _directory(0), _samplesCount(0), _maxSamples(0), _open(false) {
+	_name[0] = 0;
+}
+
+MusicCacheFile::~MusicCacheFile() {
+	close(false);
+}
+
+bool MusicCacheFile::open(const char *directory, const MusicCacheKey &key) {
+	close(false);
+	if (!directory) {
+		return false;
+	}
+	_directory = directory;
+	getCacheName(_name, sizeof(_name), key);
+	char tmpName[sizeof(_name) + 4];
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", _name);
+	if (!_f.open(tmpName, "zwb", _directory)) {
+		warning("Unable to create music cache file '%s'", tmpName);
+		return false;
+	}
+	writeKey(_f, key);
+	_maxSamples = kMaxDuration * key.rate;
+	_samplesCount = 0;
+	_open = true;
+	return true;
+}
+
+void MusicCacheFile::write(const int16_t *samples, int count) {
+	if (!_open) {
+		return;
+	}
+	uint8_t data[kChunkSize * 2 * sizeof(int16_t)];
+	while (count > 0) {
+		const int len = MIN(count, kChunkSize);
+		for (int i = 0; i < len * 2; ++i) {
+			data[i * 2] = samples[i] & 255;
+			data[i * 2 + 1] = samples[i] >> 8;
+		}
+		_f.writeUint16BE(len);
+		_f.write(data, len * 2 * sizeof(int16_t));
+		samples += len * 2;
+		count -= len;
+		_samplesCount += len;
+	}
+	if (_samplesCount >= _maxSamples) {
+		warning("Music track '%s' does not loop after %d seconds", _name, kMaxDuration);
+		close(false);
+	}
+}
+
+void MusicCacheFile::close(bool complete) {
+	if (!_open) {
+		return;
+	}
+	_open = false;
+	_f.writeUint16BE(0);
+	const bool ioErr = _f.ioErr();
+	_f.close();
+	char tmpPath[MAXPATHLEN];
+	snprintf(tmpPath, sizeof(tmpPath), "%s/%s.tmp", _directory, _name);
+	if (complete && !ioErr && _samplesCount != 0) {
+		char path[MAXPATHLEN];
+		snprintf(path, sizeof(path), "%s/%s", _directory, _name);
+		::remove(path);
+		if (rename(tmpPath, path) == 0) {
+			debug(DBG_SND, "Saved music cache '%s', %d samples", _name, _samplesCount);
+			return;
+		}
+		warning("Unable to rename music cache file '%s'", tmpPath);
+	}
+	::remove(tmpPath);
+}
+
+// reads 'len' stereo samples, the cache holds the first pass of the track and loops from the start like the players
+int MusicCache::readSamples(int16_t *buf, int len) {
+	int count = 0;
+	while (count < len) {
+		if (_chunkLeft == 0) {
+			const int n = _f.readUint16BE();
+			if (_f.ioErr() || n > kChunkSize) {
+				warning("Invalid music cache file '%s'", _name);
+				return 0;
+			}
+			if (n == 0) {
+				_f.seek(_dataPos);
+				continue;
+			}
+			_chunkLeft = n;
+			continue;
+		}
+		const int n = MIN(_chunkLeft, len - count);
+		int16_t *p = buf + count * 2;
+		if (_f.read(p, n * 2 * sizeof(int16_t)) != n * 2 * sizeof(int16_t)) {
+			warning("Truncated music cache file '%s'", _name);
+			return 0;
+		}
+		for (int i = 0; i < n * 2; ++i) {
+			p[i] = (int16_t)READ_LE_UINT16(&p[i]);
+		}
+		_chunkLeft -= n;
+		count += n;
+	}
+	return len;
+}
+
+int MusicCache::readSamplesProc(void *param, int16_t *buf, int len) {
+	return ((MusicCache *)param)->readSamples(buf, len);
+}
+
+bool MusicCache::mix(int16_t *buf, int len) {
+	return _stream.read(buf, len);
+}
+
+bool MusicCache::mixCallback(void *param, int16_t *buf, int len) {
+	return ((MusicCache *)param)->mix(buf, len);
+}
@@ -0,0 +1,90 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef MUSIC_CACHE_H__
+#define MUSIC_CACHE_H__
+
+#include <atomic>
+#include <thread>
+#include "intern.h"
+#include "file.h"
+#include "pcm_stream.h"
+
+struct Mixer;
+
+// synthesizes the first pass of a track, returns 0 once the song loops and -1 on error
+struct MusicRenderer {
+	virtual ~MusicRenderer() {}
+	virtual int render(int16_t *buf, int len) = 0;
+};
+
+struct MusicCacheKey {
+	enum {
+		kTypeMod,
+		kTypePrf
+	};
+
+	enum {
+		kBackendInternal,
+		kBackendModplug
+	};
+
+	uint8_t type;
+	uint8_t num;
+	uint16_t tempo;
+	uint8_t mode; // MIDI driver or Amiga module
+	uint8_t flags;
+	uint8_t backend; // player that synthesized the samples
+	uint32_t rate;
+};
+
+struct MusicCacheFile {
+	const char *_directory;
+	char _name[64];
+	File _f;
+	uint32_t _samplesCount, _maxSamples;
+	bool _open;
+
+	MusicCacheFile();
+	~MusicCacheFile();
+
+	bool open(const char *directory, const MusicCacheKey &key);
+	void write(const int16_t *samples, int count);
+	void close(bool complete);
+};
+
+struct MusicCache {
+	typedef MusicCacheKey Key;
+
+	const char *_directory;
+	Mixer *_mix;
+	// the cached track is streamed from the file, the samples are not kept in memory
+	File _f;
+	char _name[64];
+	uint32_t _dataPos; // offset of the first chunk
+	int _chunkLeft; // stereo samples left in the current chunk
+	bool _playing;
+	PcmStream _stream; // read ahead of the audio callback
+	std::thread _buildThread;
+	std::atomic<bool> _buildStop;
+	std::atomic<bool> _buildRunning;
+
+	MusicCache(Mixer *mix);
+	~MusicCache();
+
+	bool play(const Key &key);
+	void unload();
+	void build(const Key &key, MusicRenderer *renderer);
+	void stopBuilding();
+
+	void buildFile(Key key, MusicRenderer *renderer);
+	int readSamples(int16_t *buf, int len);
+	static int readSamplesProc(void *param, int16_t *buf, int len);
+	bool mix(int16_t *buf, int len);
+	static bool mixCallback(void *param, int16_t *buf, int len);
+};
+
+#endif // MUSIC_CACHE_H__
@@ -70,7 +70,7 @@ struct OggDecoder_impl {
 		}
 	}
 
-	bool load(const char *name, FileSystem *fs, int mixerSampleRate) {
+	bool load(const char *name, FileSystem *fs) {
 		if (!_f.open(name, "rb", fs)) {
 			return false;
 		}
@@ -86,11 +86,12 @@ struct OggDecoder_impl {
 		}
 		_open = true;
 		vorbis_info *vi = ov_info(&_ovf, -1);
-		if ((vi->channels != 1 && vi->channels != 2) || vi->rate != mixerSampleRate) {
+		if ((vi->channels != 1 && vi->channels != 2) || vi->rate <= 0) {
 			warning("Unhandled ogg/pcm format ch %d rate %d", vi->channels, vi->rate);
 			return false;
 		}
 		_channels = vi->channels;
+		_sampleRate = vi->rate;
 		return true;
 	}
 	int read(int16_t *dst, int samples) {
@@ -144,6 +145,7 @@ struct OggDecoder_impl {
 	VorbisFile _f;
 	OggVorbis_File _ovf;
 	int _channels;
+	int _sampleRate;
 	bool _open;
 	int16_t *_readBuf;
 	int _readBufSize;
@@ -163,7 +165,7 @@ struct OggDecoder_impl {
 			_v = 0;
 		}
 	}
-	bool load(const char *name, FileSystem *fs, int mixerSampleRate) {
+	bool load(const char *name, FileSystem *fs) {
 		if (!_f.open(name, "rb", fs)) {
 			return false;
 		}
@@ -175,10 +177,11 @@ struct OggDecoder_impl {
 			if (_v) {
 				_offset = bytes;
 				stb_vorbis_info info = stb_vorbis_get_info(_v);
-				if (info.channels != 2 || (int)info.sample_rate != mixerSampleRate) {
+				if (info.channels != 2 || info.sample_rate == 0) {
 					warning("Unhandled ogg/pcm format ch %d rate %d", info.channels, info.sample_rate);
 					return false;
 				}
+				_sampleRate = info.sample_rate;
 				_decodedSamplesLen = 0;
 				return true;
 			}
@@ -259,6 +262,7 @@ struct OggDecoder_impl {
 	uint8_t _buffer[8192];
 	int16_t _decodedSamples[2][1024];
 	int _decodedSamplesLen;
+	int _sampleRate;
 	uint32_t _offset, _count;
 	stb_vorbis *_v;
 	File _f;
@@ -271,6 +275,7 @@ OggPlayer::OggPlayer(Mixer *mixer, FileSystem *fs)
 }
 
 OggPlayer::~OggPlayer() {
+	_stream.stop();
 	delete _impl;
 	_impl = 0;
 }
@@ -282,8 +287,12 @@ bool OggPlayer::playTrack(int num) {
 	stopTrack();
 	char buf[16];
 	snprintf(buf, sizeof(buf), "track%02d.ogg", num);
-	if (_impl->load(buf, _fs, _mix->getSampleRate())
-		|| (num == 2 && _impl->load(kMenuThemeRemix, _fs, _mix->getSampleRate()))) {
+	if (_impl->load(buf, _fs) || (num == 2 && _impl->load(kMenuThemeRemix, _fs))) {
+		_resampler.init(_impl->_sampleRate, _mix->getSampleRate(), readTrackSamplesProc, this);
+		if (!_resampler.isPassthrough()) {
+			debug(DBG_SND, "Resampling ogg track from %d to %d Hz", _impl->_sampleRate, _mix->getSampleRate());
+		}
+		_stream.start(_mix->getSampleRate(), readSamplesProc, this);
 		_mix->setPremixHook(mixCallback, this);
 		return true;
 	}
@@ -293,11 +302,13 @@ bool OggPlayer::playTrack(int num) {
 void OggPlayer::stopTrack() {
 	if (_impl) {
 		_mix->setPremixHook(0, 0);
+		_stream.stop();
 	}
 }
 
 void OggPlayer::pauseTrack() {
 	if (_impl) {
+		// the queue is no longer read, the decoding thread fills it and then polls for room every 10ms
 		_mix->setPremixHook(0, 0);
 	}
 }
@@ -308,14 +319,45 @@ void OggPlayer::resumeTrack() {
 	}
 }
 
+// decodes 'len' stereo samples at the track rate, returns 0 on error
+int OggPlayer::readTrackSamples(int16_t *buf, int len) {
+	memset(buf, 0, len * 2 * sizeof(int16_t));
+	return (_impl->read(buf, len) != 0) ? len : 0;
+}
+
+int OggPlayer::readTrackSamplesProc(void *param, int16_t *buf, int len) {
+	return ((OggPlayer *)param)->readTrackSamples(buf, len);
+}
+
+// decodes 'len' stereo samples at the mixer rate
+int OggPlayer::readSamples(int16_t *buf, int len) {
+	if (_resampler.isPassthrough()) {
+		return readTrackSamples(buf, len);
+	}
+	return (_resampler.read(buf, len) == len) ? len : 0;
+}
+
+int OggPlayer::readSamplesProc(void *param, int16_t *buf, int len) {
+	return ((OggPlayer *)param)->readSamples(buf, len);
+}
+
 bool OggPlayer::mix(int16_t *buf, int len) {
-	if (_impl) {
-		return _impl->read(buf, len) != 0;
+	while (len > 0) {
+		int16_t samples[512];
+		const int count = MIN(len, ARRAYSIZE(samples) / 2);
+		const bool ret = _stream.read(samples, count);
+		for (int i = 0; i < count * 2; ++i) {
+			buf[i] = ADDC_S16(buf[i], samples[i]);
+		}
+		if (!ret) {
+			return false;
+		}
+		buf += count * 2;
+		len -= count;
 	}
-	return false;
+	return true;
 }
 
 bool OggPlayer::mixCallback(void *param, int16_t *buf, int len) {
 	return ((OggPlayer *)param)->mix(buf, len);
 }
-
@@ -8,6 +8,8 @@
 #define OGG_PLAYER_H__
 
 #include "intern.h"
+#include "pcm_resampler.h"
+#include "pcm_stream.h"
 
 struct FileSystem;
 struct Mixer;
@@ -22,12 +24,18 @@ struct OggPlayer {
 	void pauseTrack();
 	void resumeTrack();
 	bool isPlaying() const { return _impl != 0; }
+	int readTrackSamples(int16_t *buf, int len);
+	static int readTrackSamplesProc(void *param, int16_t *buf, int len);
+	int readSamples(int16_t *buf, int len);
+	static int readSamplesProc(void *param, int16_t *buf, int len);
 	bool mix(int16_t *buf, int len);
 	static bool mixCallback(void *param, int16_t *buf, int len);
 
 	Mixer *_mix;
 	FileSystem *_fs;
 	OggDecoder_impl *_impl;
+	PcmResampler _resampler; // track sample rate to the mixer rate
+	PcmStream _stream; // decoded ahead of the audio callback
 };
 
 #endif // OGG_PLAYER_H__
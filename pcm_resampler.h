@@ -0,0 +1,81 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef PCM_RESAMPLER_H__
+#define PCM_RESAMPLER_H__
+
+#include "intern.h"
+
+// Converts a stereo stream to the mixer output rate with linear interpolation.
+// The source samples are pulled with the read callback, which returns the
+// number of stereo samples decoded, 0 at the end of the stream.
+
+struct PcmResampler {
+	typedef int (*ReadProc)(void *param, int16_t *buf, int len);
+
+	enum {
+		kFracBits = 16,
+		kChunkSize = 256 // stereo samples
+	};
+
+	ReadProc _readProc;
+	void *_readParam;
+	uint32_t _step, _frac;
+	int16_t _cur[2], _next[2];
+	int16_t _chunk[kChunkSize * 2];
+	int _chunkPos, _chunkLen;
+
+	PcmResampler()
+		: _readProc(0), _readParam(0), _step(1 << kFracBits), _frac(0), _chunkPos(0), _chunkLen(0) {
+	}
+
+	void init(int srcRate, int dstRate, ReadProc proc, void *param) {
+		_readProc = proc;
+		_readParam = param;
+		_step = (uint32_t)(((uint64_t)srcRate << kFracBits) / dstRate);
+		// the first output sample reads the first two source samples
+		_frac = 2 << kFracBits;
+		_cur[0] = _cur[1] = _next[0] = _next[1] = 0;
+		_chunkPos = _chunkLen = 0;
+	}
+	bool isPassthrough() const {
+		return _step == (1 << kFracBits);
+	}
+	bool nextSample() {
+		if (_chunkPos == _chunkLen) {
+			_chunkPos = 0;
+			_chunkLen = _readProc(_readParam, _chunk, kChunkSize);
+			if (_chunkLen <= 0) {
+				_chunkLen = 0;
+				return false;
+			}
+		}
+		_cur[0] = _next[0];
+		_cur[1] = _next[1];
+		_next[0] = _chunk[_chunkPos * 2];
+		_next[1] = _chunk[_chunkPos * 2 + 1];
+		++_chunkPos;
+		return true;
+	}
+	// writes 'len' stereo samples, returns fewer at the end of the stream
+	int read(int16_t *dst, int len) {
+		for (int i = 0; i < len; ++i) {
+			while (_frac >= (1 << kFracBits)) {
+				if (!nextSample()) {
+					return i;
+				}
+				_frac -= 1 << kFracBits;
+			}
+			for (int c = 0; c < 2; ++c) {
+				*dst++ = _cur[c] + (int)(((int64_t)(_next[c] - _cur[c]) * _frac) >> kFracBits);
+			}
+			_frac += _step;
+		}
+		return len;
+	}
+};
+
+#endif // PCM_RESAMPLER_H__
@@ -0,0 +1,94 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "pcm_stream.h"
+#include "util.h"
+
+PcmStream::PcmStream()
+	: _readProc(0), _readParam(0), _queueSize(0), _stop(false), _end(false) {
+}
+
+PcmStream::~PcmStream() {
+	stop();
+}
+
+void PcmStream::start(uint32_t rate, ReadProc proc, void *param) {
+	stop();
+	_readProc = proc;
+	_readParam = param;
+	if (g_options.music_lookahead <= 0) {
+		return;
+	}
+	// the queue holds 'music_lookahead' ms at the mixer rate
+	const int size = MAX(rate * g_options.music_lookahead / 1000, (uint32_t)kChunkSize) * 2;
+	if (size != _queueSize) {
+		if (!_queue.init(size)) {
+			warning("Unable to allocate %d samples for the music streaming queue", size);
+			_queueSize = 0;
+			return;
+		}
+		_queueSize = size;
+	}
+	_queue.reset();
+	_stop = false;
+	_end = false;
+	_thread = std::thread(threadProc, this);
+}
+
+void PcmStream::stop() {
+	if (_thread.joinable()) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_stop = true;
+			_cond.notify_all();
+		}
+		_thread.join();
+	}
+	// the premix hook is removed, the queue is not read anymore
+	_queue.reset();
+}
+
+// writes 'len' stereo samples, silent if the reading thread is late, returns false at the end of the stream
+bool PcmStream::read(int16_t *buf, int len) {
+	if (!_thread.joinable()) {
+		if (_readProc(_readParam, buf, len) == 0) {
+			memset(buf, 0, len * 2 * sizeof(int16_t));
+			return false;
+		}
+		return true;
+	}
+	const int count = _queue.read(buf, len * 2);
+	if (count < len * 2) {
+		memset(buf + count, 0, (len * 2 - count) * sizeof(int16_t));
+		return !_end.load(std::memory_order_acquire) || _queue.available() != 0;
+	}
+	return true;
+}
+
+void PcmStream::readAhead() {
+	int16_t samples[kChunkSize * 2];
+	while (true) {
+		{
+			// poll the queue, the audio callback does not signal when it has read samples
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (!_stop && _queue.space() < kChunkSize * 2) {
+				_cond.wait_for(lock, std::chrono::milliseconds(10));
+			}
+			if (_stop) {
+				break;
+			}
+		}
+		if (_readProc(_readParam, samples, kChunkSize) == 0) {
+			_end.store(true, std::memory_order_release);
+			break;
+		}
+		_queue.write(samples, kChunkSize * 2);
+	}
+}
+
+void PcmStream::threadProc(PcmStream *stream) {
+	stream->readAhead();
+}
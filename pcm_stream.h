@@ -0,0 +1,50 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef PCM_STREAM_H__
+#define PCM_STREAM_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "intern.h"
+#include "ring_buffer.h"
+
+// Reads a stereo stream ahead of the audio callback from a thread. The samples
+// are pulled with the read callback, which returns the number of stereo samples
+// read, 0 at the end of the stream. With a music lookahead of 0, the callback
+// is called from the audio callback.
+
+struct PcmStream {
+	typedef int (*ReadProc)(void *param, int16_t *buf, int len);
+
+	enum {
+		kChunkSize = 1024 // stereo samples
+	};
+
+	ReadProc _readProc;
+	void *_readParam;
+	// written by the reading thread and read by the audio callback
+	RingBuffer<int16_t> _queue;
+	int _queueSize;
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _cond;
+	bool _stop;
+	std::atomic<bool> _end;
+
+	PcmStream();
+	~PcmStream();
+
+	void start(uint32_t rate, ReadProc proc, void *param);
+	void stop();
+	bool read(int16_t *buf, int len);
+	void readAhead();
+	static void threadProc(PcmStream *stream);
+};
+
+#endif // PCM_STREAM_H__
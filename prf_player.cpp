@@ -28,8 +28,10 @@ static const struct {
 
 static const int kMusicVolume = 63;
 
+static const int kRenderChunkSize = 512; // stereo samples
+
 PrfPlayer::PrfPlayer(Mixer *mix, FileSystem *fs, int mode)
-	: _playing(false), _mixer(mix), _fs(fs), _mode(mode), _driver(0) {
+	: _playing(false), _mixer(mix), _fs(fs), _mode(mode), _driver(0), _renderQueueSize(0), _renderStop(false) {
 	for (int i = 0; _midiDrivers[i].info; ++i) {
 		if (_midiDrivers[i].mode == mode) {
 			_timerHz = _midiDrivers[i].hz;
@@ -48,6 +50,7 @@ PrfPlayer::PrfPlayer(Mixer *mix, FileSystem *fs, int mode)
 }
 
 PrfPlayer::~PrfPlayer() {
+	stopRendering();
 	if (_driver) {
 		_driver->fini();
 		_driver = 0;
@@ -55,7 +58,32 @@ PrfPlayer::~PrfPlayer() {
 }
 
 void PrfPlayer::play(int num) {
-	_playing = false;
+	stop();
+	if (!_driver) {
+		return;
+	}
+	MusicCache::Key key;
+	key.type = MusicCacheKey::kTypePrf;
+	key.num = num;
+	key.tempo = 0;
+	key.mode = _mode;
+	key.flags = g_options.fix_fmopl_e0_reg ? 1 : 0;
+	key.backend = MusicCacheKey::kBackendInternal;
+	key.rate = _mixer->getSampleRate();
+	if (g_options.use_music_cache && _mixer->_musicCache.play(key)) {
+		_playing = true;
+		return;
+	}
+	if (load(num)) {
+		// the first pass of the track is recorded while it is rendered ahead, that requires a known duration
+		if (g_options.use_music_cache && g_options.music_lookahead > 0 && _prfData.totalDurationTicks != 0) {
+			_cacheFile.open(_mixer->_musicCache._directory, key);
+		}
+		play();
+	}
+}
+
+bool PrfPlayer::load(int num) {
 	memset(&_prfData, 0, sizeof(_prfData));
 	memset(&_tracks, 0, sizeof(_tracks));
 	if (num < _namesCount) {
@@ -83,10 +111,11 @@ void PrfPlayer::play(int num) {
 				warning("Failed to open MIDI file '%s'", _prfData.midi);
 			} else {
 				_parser.loadMid(&f);
-				play();
+				return true;
 			}
 		}
 	}
+	return false;
 }
 
 void PrfPlayer::loadPrf(File *f) {
@@ -159,6 +188,13 @@ void PrfPlayer::play() {
 	if (!_driver) {
 		return;
 	}
+	reset();
+	_playing = true;
+	startRendering();
+	_mixer->setPremixHook(mixCallback, this);
+}
+
+void PrfPlayer::reset() {
 	_driver->reset(_mixer->getSampleRate());
 	for (int i = 0; i < _parser._tracksCount; ++i) {
 		_tracks[i].instrument_num = i;
@@ -181,15 +217,17 @@ void PrfPlayer::play() {
 	_timerTick = _musicTick = 0;
 	_samplesLeft = 0;
 	_samplesPerTick = _mixer->getSampleRate() / _timerHz;
-	_playing = true;
-	_mixer->setPremixHook(mixCallback, this);
 }
 
 void PrfPlayer::stop() {
 	if (_playing) {
 		_mixer->setPremixHook(0, 0);
+		_mixer->_musicCache.unload();
 		_playing = false;
 	}
+	stopRendering();
+	// the track was stopped before the end of its first pass
+	_cacheFile.close(false);
 }
 
 void PrfPlayer::mt32NoteOn(int track, int note, int velocity) {
@@ -415,6 +453,67 @@ bool PrfPlayer::mixCallback(void *param, int16_t *buf, int len) {
 }
 
 bool PrfPlayer::mix(int16_t *buf, int len) {
+	if (_renderThread.joinable()) {
+		// an underrun leaves the remaining samples silent
+		_renderQueue.read(buf, len * 2);
+		return true;
+	}
 	const int count = readSamples(buf, len);
 	return count != 0;
 }
+
+void PrfPlayer::startRendering() {
+	if (g_options.music_lookahead <= 0) {
+		return;
+	}
+	const int size = MAX(_mixer->getSampleRate() * g_options.music_lookahead / 1000, (uint32_t)kRenderChunkSize) * 2;
+	if (size != _renderQueueSize) {
+		if (!_renderQueue.init(size)) {
+			warning("Unable to allocate %d samples for the music rendering queue", size);
+			_renderQueueSize = 0;
+			return;
+		}
+		_renderQueueSize = size;
+	}
+	_renderQueue.reset();
+	_renderStop = false;
+	_renderThread = std::thread(renderThreadProc, this);
+}
+
+void PrfPlayer::stopRendering() {
+	if (_renderThread.joinable()) {
+		{
+			std::unique_lock<std::mutex> lock(_renderMutex);
+			_renderStop = true;
+			_renderCond.notify_all();
+		}
+		_renderThread.join();
+	}
+}
+
+void PrfPlayer::renderSamples() {
+	int16_t samples[kRenderChunkSize * 2];
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(_renderMutex);
+			while (!_renderStop && _renderQueue.space() < kRenderChunkSize * 2) {
+				_renderCond.wait_for(lock, std::chrono::milliseconds(5));
+			}
+			if (_renderStop) {
+				break;
+			}
+		}
+		readSamples(samples, kRenderChunkSize);
+		_renderQueue.write(samples, kRenderChunkSize * 2);
+		if (_cacheFile._open) {
+			_cacheFile.write(samples, kRenderChunkSize);
+			if (end()) {
+				_cacheFile.close(true);
+			}
+		}
+	}
+}
+
+void PrfPlayer::renderThreadProc(PrfPlayer *player) {
+	player->renderSamples();
+}
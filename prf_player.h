@@ -3,7 +3,12 @@
 #define PRF_PLAYER_H__
 
 #include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include "midi_parser.h"
+#include "music_cache.h"
+#include "ring_buffer.h"
 
 static const int TIMER_ADLIB_HZ = 2082;
 static const int TIMER_MT32_HZ  = 2242;
@@ -81,11 +86,13 @@ struct PrfPlayer {
 	~PrfPlayer();
 
 	void play(int num);
+	bool load(int num);
 
 	void loadPrf(File *f);
 	void loadIns(File *f, int num);
 
 	void play();
+	void reset();
 	void stop();
 
 	void mt32NoteOn(int track, int note, int velocity);
@@ -105,6 +112,11 @@ struct PrfPlayer {
 	static bool mixCallback(void *param, int16_t *buf, int len);
 	bool mix(int16_t *buf, int len);
 
+	void startRendering();
+	void stopRendering();
+	void renderSamples();
+	static void renderThreadProc(PrfPlayer *player);
+
 	bool _playing;
 	Mixer *_mixer;
 	FileSystem *_fs;
@@ -117,6 +129,14 @@ struct PrfPlayer {
 	int _samplesLeft, _samplesPerTick;
 	uint32_t _timerTick, _musicTick;
 	uint8_t _adlibInstrumentData[16][ADLIB_INSTRUMENT_DATA_LEN];
+	// samples synthesized ahead by the rendering thread, read by the audio callback
+	RingBuffer<int16_t> _renderQueue;
+	int _renderQueueSize;
+	std::thread _renderThread;
+	std::mutex _renderMutex;
+	std::condition_variable _renderCond;
+	bool _renderStop;
+	MusicCacheFile _cacheFile; // written by the rendering thread on the first play of a track
 };
 
 #endif /* PRF_PLAYER_H__ */
@@ -4,6 +4,10 @@
  * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
+#include <atomic>
+#include <math.h>
+#include <mutex>
+#include <thread>
 #include "decode_mac.h"
 #include "file.h"
 #include "fs.h"
@@ -29,7 +33,6 @@ Resource::Resource(FileSystem *fs, ResourceType ver, Language lang) {
 	if (!_scratchBuffer) {
 		error("Unable to allocate temporary memory buffer");
 	}
-	static const int kBankDataSize = 0x7000;
 	_bankData = (uint8_t *)malloc(kBankDataSize);
 	if (!_bankData) {
 		error("Unable to allocate bank data buffer");
@@ -39,6 +42,7 @@ Resource::Resource(FileSystem *fs, ResourceType ver, Language lang) {
 }
 
 Resource::~Resource() {
+	clearStagedLevelData();
 	clearLevelRes();
 	MAC_unloadLevelData();
 	free(_fnt);
@@ -51,10 +55,7 @@ Resource::~Resource() {
 	free(_pol);
 	free(_cine_off);
 	free(_cine_txt);
-	for (int i = 0; i < _numSfx; ++i) {
-		free(_sfxList[i].data);
-	}
-	free(_sfxList);
+	freeSfx();
 	free(_bankData);
 	delete _aba;
 	delete _mac;
@@ -74,11 +75,11 @@ void Resource::init() {
 		break;
 	case kResourceTypeDOS:
 		if (_fs->exists(_demoAba)) { // fbdemous
-			_aba = new ResourceAba(_fs);
+			_aba = new ResourceAba(_fs, &_unpackCache);
 			_aba->readEntries(_demoAba);
 			_isDemo = true;
 		} else if (_fs->exists(_joystickAba[0])) { // Joystick "Hors Serie" April 1996
-			_aba = new ResourceAba(_fs);
+			_aba = new ResourceAba(_fs, &_unpackCache);
 			for (int i = 0; _joystickAba[i]; ++i) {
 				_aba->readEntries(_joystickAba[i]);
 			}
@@ -96,7 +97,7 @@ void Resource::init() {
 		_mac->load();
 		break;
 	case kResourceTypePC98:
-		_paq = new ResourcePaq(_fs);
+		_paq = new ResourcePaq(_fs, &_unpackCache);
 		_paq->open();
 		_archive = _paq;
 		break;
@@ -106,6 +107,7 @@ void Resource::init() {
 }
 
 void Resource::fini() {
+	clearStagedLevelData();
 }
 
 void Resource::setLanguage(Language lang) {
@@ -223,6 +225,86 @@ static void decodeSfxFibonacci(SoundFx *sfx, File &f) {
 	sfx->len = len;
 }
 
+// windowed sinc, band-limited to the lower of the two rates
+static const int kSincZeroCrossings = 8;
+static const int kSincPhases = 64;
+
+static float _sincTable[kSincZeroCrossings * kSincPhases + 2];
+
+static void initSincTable() {
+	if (_sincTable[0] != 0.f) {
+		return;
+	}
+	static const int size = kSincZeroCrossings * kSincPhases;
+	for (int i = 0; i <= size; ++i) {
+		const double x = i / (double)kSincPhases;
+		const double sinc = (i == 0) ? 1. : sin(M_PI * x) / (M_PI * x);
+		// Blackman window
+		const double w = 0.42 + 0.5 * cos(M_PI * i / size) + 0.08 * cos(2 * M_PI * i / size);
+		_sincTable[i] = sinc * w;
+	}
+	_sincTable[size + 1] = 0.f;
+}
+
+static float getSincTable(double x) {
+	const double pos = x * kSincPhases;
+	const int i = (int)pos;
+	if (i >= kSincZeroCrossings * kSincPhases) {
+		return 0.f;
+	}
+	const float frac = pos - i;
+	return _sincTable[i] + (_sincTable[i + 1] - _sincTable[i]) * frac;
+}
+
+static int16_t *resampleS8(const int8_t *src, int srcLen, int srcRate, int dstRate, uint32_t *dstLen) {
+	const int len = ((int64_t)srcLen * dstRate + srcRate - 1) / srcRate;
+	int16_t *dst = (int16_t *)malloc(len * sizeof(int16_t));
+	if (!dst) {
+		return 0;
+	}
+	const double step = srcRate / (double)dstRate;
+	const double scale = (dstRate < srcRate) ? dstRate / (double)srcRate : 1.;
+	const double radius = kSincZeroCrossings / scale;
+	for (int j = 0; j < len; ++j) {
+		const double t = j * step;
+		const int i0 = MAX(0, (int)ceil(t - radius));
+		const int i1 = MIN(srcLen - 1, (int)floor(t + radius));
+		float sum = 0.f;
+		for (int i = i0; i <= i1; ++i) {
+			sum += S8_to_S16(src[i]) * getSincTable(fabs(t - i) * scale);
+		}
+		dst[j] = CLIP((int)lrintf(sum * scale), -32768, 32767);
+	}
+	*dstLen = len;
+	return dst;
+}
+
+void Resource::resampleSfx() {
+	if (_sfxOutputRate == 0) {
+		return;
+	}
+	initSincTable();
+	for (int i = 0; i < _numSfx; ++i) {
+		SoundFx *sfx = &_sfxList[i];
+		free(sfx->pcm);
+		sfx->pcm = 0;
+		sfx->pcmLen = 0;
+		if (sfx->data && sfx->len != 0 && sfx->freq != 0) {
+			sfx->pcm = resampleS8((const int8_t *)sfx->data, sfx->len, sfx->freq, _sfxOutputRate, &sfx->pcmLen);
+		}
+	}
+}
+
+void Resource::freeSfx() {
+	for (int i = 0; i < _numSfx; ++i) {
+		free(_sfxList[i].data);
+		free(_sfxList[i].pcm);
+	}
+	free(_sfxList);
+	_sfxList = 0;
+	_numSfx = 0;
+}
+
 void Resource::load_FIB(const char *fileName) {
 	debug(DBG_RES, "Resource::load_FIB('%s')", fileName);
 	snprintf(_entryName, sizeof(_entryName), "%s.FIB", fileName);
@@ -239,6 +321,8 @@ void Resource::load_FIB(const char *fileName) {
 			sfx->len = f.readUint16LE();
 			sfx->freq = 6000;
 			sfx->data = 0;
+			sfx->pcm = 0;
+			sfx->pcmLen = 0;
 		}
 		for (int i = 0; i < _numSfx; ++i) {
 			SoundFx *sfx = &_sfxList[i];
@@ -250,6 +334,7 @@ void Resource::load_FIB(const char *fileName) {
 		if (f.ioErr()) {
 			error("I/O error when reading '%s'", _entryName);
 		}
+		resampleSfx();
 	} else {
 		error("Cannot open '%s'", _entryName);
 	}
@@ -289,6 +374,7 @@ void Resource::load_SPL_demo() {
 			}
 		}
 	}
+	resampleSfx();
 }
 
 void Resource::load_MAP_menu(const char *fileName, uint8_t *dstPtr) {
@@ -351,15 +437,15 @@ void Resource::load_CMP_menu(const char *fileName) {
 	File f;
 	if (f.open(fileName, "rb", _fs)) {
 		const uint32_t size = f.readUint32BE();
-		uint8_t *tmp = (uint8_t *)malloc(size);
+		uint8_t *buf;
+		const uint8_t *tmp = f.readData(size, &buf);
 		if (!tmp) {
 			error("Failed to allocate CMP temporary buffer");
 		}
-		f.read(tmp, size);
 		if (!bytekiller_unpack(_scratchBuffer, kScratchBufferSize, tmp, size)) {
 			error("Bad CRC for %s", fileName);
 		}
-                free(tmp);
+		free(buf);
 		return;
 	}
 	error("Cannot load '%s'", fileName);
@@ -646,127 +732,140 @@ void Resource::unload(int objType) {
 	}
 }
 
-void Resource::load(const char *objName, int objType, const char *ext) {
-	debug(DBG_RES, "Resource::load('%s', %d)", objName, objType);
-	LoadProc loadProc = 0;
+void Resource::getEntryName(char *entryName, int size, const char *objName, int objType, const char *ext, LoadProc *loadProc) {
+	*loadProc = 0;
 	switch (objType) {
 	case OT_MBK:
-		snprintf(_entryName, sizeof(_entryName), "%s.MBK", objName);
-		loadProc = &Resource::load_MBK;
+		snprintf(entryName, size, "%s.MBK", objName);
+		*loadProc = &Resource::load_MBK;
 		break;
 	case OT_PGE:
-		snprintf(_entryName, sizeof(_entryName), "%s.PGE", objName);
-		loadProc = &Resource::load_PGE;
+		snprintf(entryName, size, "%s.PGE", objName);
+		*loadProc = &Resource::load_PGE;
 		break;
 	case OT_PAL:
-		snprintf(_entryName, sizeof(_entryName), "%s.PAL", objName);
-		loadProc = &Resource::load_PAL;
+		snprintf(entryName, size, "%s.PAL", objName);
+		*loadProc = &Resource::load_PAL;
 		break;
 	case OT_CT:
-		snprintf(_entryName, sizeof(_entryName), "%s.CT", objName);
-		loadProc = &Resource::load_CT;
+		snprintf(entryName, size, "%s.CT", objName);
+		*loadProc = &Resource::load_CT;
 		break;
 	case OT_MAP:
-		snprintf(_entryName, sizeof(_entryName), "%s.MAP", objName);
-		loadProc = &Resource::load_MAP;
+		snprintf(entryName, size, "%s.MAP", objName);
+		*loadProc = &Resource::load_MAP;
 		break;
 	case OT_SPC:
-		snprintf(_entryName, sizeof(_entryName), "%s.SPC", objName);
-		loadProc = &Resource::load_SPC;
+		snprintf(entryName, size, "%s.SPC", objName);
+		*loadProc = &Resource::load_SPC;
 		break;
 	case OT_RP:
-		snprintf(_entryName, sizeof(_entryName), "%s.RP", objName);
-		loadProc = &Resource::load_RP;
+		snprintf(entryName, size, "%s.RP", objName);
+		*loadProc = &Resource::load_RP;
 		break;
 	case OT_RPC:
-		snprintf(_entryName, sizeof(_entryName), "%s.RPC", objName);
-		loadProc = &Resource::load_RP;
+		snprintf(entryName, size, "%s.RPC", objName);
+		*loadProc = &Resource::load_RP;
 		break;
 	case OT_SPR:
-		snprintf(_entryName, sizeof(_entryName), "%s.SPR", objName);
-		loadProc = &Resource::load_SPR;
+		snprintf(entryName, size, "%s.SPR", objName);
+		*loadProc = &Resource::load_SPR;
 		break;
 	case OT_SPRM:
-		snprintf(_entryName, sizeof(_entryName), "%s.SPR", objName);
-		loadProc = &Resource::load_SPRM;
+		snprintf(entryName, size, "%s.SPR", objName);
+		*loadProc = &Resource::load_SPRM;
 		break;
 	case OT_ICN:
-		snprintf(_entryName, sizeof(_entryName), "%s.ICN", objName);
-		loadProc = &Resource::load_ICN;
+		snprintf(entryName, size, "%s.ICN", objName);
+		*loadProc = &Resource::load_ICN;
 		break;
 	case OT_FNT:
-		snprintf(_entryName, sizeof(_entryName), "%s.FNT", objName);
-		loadProc = &Resource::load_FNT;
+		snprintf(entryName, size, "%s.FNT", objName);
+		*loadProc = &Resource::load_FNT;
 		break;
 	case OT_OBJ:
-		snprintf(_entryName, sizeof(_entryName), "%s.OBJ", objName);
-		loadProc = &Resource::load_OBJ;
+		snprintf(entryName, size, "%s.OBJ", objName);
+		*loadProc = &Resource::load_OBJ;
 		break;
 	case OT_ANI:
-		snprintf(_entryName, sizeof(_entryName), "%s.ANI", objName);
-		loadProc = &Resource::load_ANI;
+		snprintf(entryName, size, "%s.ANI", objName);
+		*loadProc = &Resource::load_ANI;
 		break;
 	case OT_TBN:
-		snprintf(_entryName, sizeof(_entryName), "%s.%s", objName, getTextBin(_lang, _type));
-		if (!_fs->exists(_entryName)) {
-			snprintf(_entryName, sizeof(_entryName), "%s.TBN", objName);
+		snprintf(entryName, size, "%s.%s", objName, getTextBin(_lang, _type));
+		if (!_fs->exists(entryName)) {
+			snprintf(entryName, size, "%s.TBN", objName);
 		}
-		loadProc = &Resource::load_TBN;
+		*loadProc = &Resource::load_TBN;
 		break;
 	case OT_CMD:
-		snprintf(_entryName, sizeof(_entryName), "%s.CMD", objName);
-		loadProc = &Resource::load_CMD;
+		snprintf(entryName, size, "%s.CMD", objName);
+		*loadProc = &Resource::load_CMD;
 		break;
 	case OT_POL:
-		snprintf(_entryName, sizeof(_entryName), "%s.POL", objName);
-		loadProc = &Resource::load_POL;
+		snprintf(entryName, size, "%s.POL", objName);
+		*loadProc = &Resource::load_POL;
 		break;
 	case OT_CMP:
-		snprintf(_entryName, sizeof(_entryName), "%s.CMP", objName);
-		loadProc = &Resource::load_CMP;
+		snprintf(entryName, size, "%s.CMP", objName);
+		*loadProc = &Resource::load_CMP;
 		break;
 	case OT_OBC:
-		snprintf(_entryName, sizeof(_entryName), "%s.OBC", objName);
-		loadProc = &Resource::load_OBC;
+		snprintf(entryName, size, "%s.OBC", objName);
+		*loadProc = &Resource::load_OBC;
 		break;
 	case OT_SPL:
-		snprintf(_entryName, sizeof(_entryName), "%s.SPL", objName);
-		loadProc = &Resource::load_SPL;
+		snprintf(entryName, size, "%s.SPL", objName);
+		*loadProc = &Resource::load_SPL;
 		break;
 	case OT_LEV:
-		snprintf(_entryName, sizeof(_entryName), "%s.LEV", objName);
-		loadProc = &Resource::load_LEV;
+		snprintf(entryName, size, "%s.LEV", objName);
+		*loadProc = &Resource::load_LEV;
 		break;
 	case OT_SGD:
-		snprintf(_entryName, sizeof(_entryName), "%s.SGD", objName);
-		loadProc = &Resource::load_SGD;
+		snprintf(entryName, size, "%s.SGD", objName);
+		*loadProc = &Resource::load_SGD;
 		break;
 	case OT_BNQ:
-		snprintf(_entryName, sizeof(_entryName), "%s.BNQ", objName);
-		loadProc = &Resource::load_BNQ;
+		snprintf(entryName, size, "%s.BNQ", objName);
+		*loadProc = &Resource::load_BNQ;
 		break;
 	case OT_SPM:
-		snprintf(_entryName, sizeof(_entryName), "%s.SPM", objName);
-		loadProc = &Resource::load_SPM;
+		snprintf(entryName, size, "%s.SPM", objName);
+		*loadProc = &Resource::load_SPM;
 		break;
 	default:
 		error("Unimplemented Resource::load() type %d", objType);
 		break;
 	}
 	if (ext) {
-		snprintf(_entryName, sizeof(_entryName), "%s.%s", objName, ext);
+		snprintf(entryName, size, "%s.%s", objName, ext);
 	}
+}
+
+void Resource::load(const char *objName, int objType, const char *ext) {
+	debug(DBG_RES, "Resource::load('%s', %d)", objName, objType);
+	char entryName[32]; // not _entryName, the level resources are loaded from several threads
+	LoadProc loadProc;
+	getEntryName(entryName, sizeof(entryName), objName, objType, ext, &loadProc);
 	File f;
-	if (f.open(_entryName, "rb", _fs)) {
+	uint8_t *stagedData = 0;
+	uint32_t stagedSize = 0;
+	bool stagedArchiveEntry = false;
+	const bool staged = takeStagedEntry(entryName, &stagedData, &stagedSize, &stagedArchiveEntry);
+	if (staged && !stagedArchiveEntry) {
+		f.openMemoryBuffer(stagedData, stagedSize);
+	}
+	if (staged ? !stagedArchiveEntry : f.open(entryName, "rb", _fs)) {
 		assert(loadProc);
 		(this->*loadProc)(&f);
 		if (f.ioErr()) {
-			error("I/O error when reading '%s'", _entryName);
+			error("I/O error when reading '%s'", entryName);
 		}
 	} else {
 		if (_archive) {
-			uint32_t size;
-			uint8_t *dat = _archive->loadEntry(_entryName, &size);
+			uint32_t size = stagedSize;
+			uint8_t *dat = staged ? stagedData : _archive->loadEntry(entryName, &size);
 			if (dat) {
 				switch (objType) {
 				case OT_MBK:
@@ -780,7 +879,7 @@ void Resource::load(const char *objName, int objType, const char *ext) {
 					break;
 				case OT_CT:
 					if (!bytekiller_unpack((uint8_t *)_ctData, sizeof(_ctData), dat, size)) {
-						error("Bad CRC for '%s'", _entryName);
+						error("Bad CRC for '%s'", entryName);
 					}
 					free(dat);
 					break;
@@ -790,7 +889,7 @@ void Resource::load(const char *objName, int objType, const char *ext) {
 					break;
 				case OT_RP:
 					if (size != sizeof(_rp)) {
-						error("Unexpected size %d for '%s'", size, _entryName);
+						error("Unexpected size %d for '%s'", size, entryName);
 					}
 					memcpy(_rp, dat, size);
 					free(dat);
@@ -819,9 +918,11 @@ void Resource::load(const char *objName, int objType, const char *ext) {
 					break;
 				case OT_CMD:
 					_cmd = dat;
+					_cmdSize = size;
 					break;
 				case OT_POL:
 					_pol = dat;
+					_polSize = size;
 					break;
 				case OT_SPRM:
 					assert(memcmp(dat, "SPP", 3) == 0);
@@ -835,7 +936,7 @@ void Resource::load(const char *objName, int objType, const char *ext) {
 					_bnq = dat;
 					break;
 				default:
-					error("Cannot load '%s' type %d", _entryName, objType);
+					error("Cannot load '%s' type %d", entryName, objType);
 				}
 				return;
 			}
@@ -845,26 +946,194 @@ void Resource::load(const char *objName, int objType, const char *ext) {
 			case OT_CMD:
 			case OT_POL:
 			case OT_CMP:
-				warning("Unable to load '%s' type %d", _entryName, objType);
+				warning("Unable to load '%s' type %d", entryName, objType);
 				return;
 			}
 		}
-		error("Cannot open '%s'", _entryName);
+		error("Cannot open '%s'", entryName);
+	}
+}
+
+static void loadJobsProc(Resource *res, const Resource::LoadJob *jobs, int count, std::atomic<int> *next) {
+	int i;
+	while ((i = next->fetch_add(1)) < count) {
+		res->load(jobs[i].objName, jobs[i].objType, jobs[i].ext);
+	}
+}
+
+// each job loads a different object type and only writes the members of that type
+void Resource::loadJobs(const LoadJob *jobs, int count) {
+	const int threadsCount = MIN(MIN((int)std::thread::hardware_concurrency(), (int)kMaxLoadThreads), count);
+	std::atomic<int> next(0);
+	std::thread threads[kMaxLoadThreads];
+	for (int i = 1; i < threadsCount; ++i) {
+		threads[i] = std::thread(loadJobsProc, this, jobs, count, &next);
+	}
+	loadJobsProc(this, jobs, count, &next);
+	for (int i = 1; i < threadsCount; ++i) {
+		threads[i].join();
+	}
+	debug(DBG_RES, "Loaded %d resources with %d threads", count, MAX(threadsCount, 1));
+}
+
+struct ResourceStagingEntry {
+	char name[32];
+	uint8_t *data;
+	uint32_t size;
+	bool archiveEntry; // unpacked archive entry, file content otherwise
+};
+
+struct ResourceStaging {
+	enum {
+		kMaxEntries = 16,
+		kMaxSize = 4 * 1024 * 1024
+	};
+
+	Resource *_res;
+	int _level;
+	ResourceStagingEntry _entries[kMaxEntries];
+	int _entriesCount;
+	uint32_t _size;
+	std::thread _thread;
+	std::atomic<bool> _stop;
+	bool _ready; // the thread is done and Resource::load can take the entries
+	std::mutex _mutex;
+
+	ResourceStaging(Resource *res, int level)
+		: _res(res), _level(level), _entriesCount(0), _size(0), _stop(false), _ready(false) {
+		memset(_entries, 0, sizeof(_entries));
+	}
+
+	~ResourceStaging() {
+		stop();
+		for (int i = 0; i < _entriesCount; ++i) {
+			free(_entries[i].data);
+		}
+	}
+
+	void start() {
+		_thread = std::thread(&ResourceStaging::readEntries, this);
+	}
+
+	void stop() {
+		if (_thread.joinable()) {
+			_stop = true;
+			_thread.join();
+		}
+	}
+
+	void wait() {
+		if (_thread.joinable()) {
+			_thread.join();
+		}
+		_ready = true;
+	}
+
+	void readEntries() {
+		for (int i = 0; i < _entriesCount && !_stop; ++i) {
+			ResourceStagingEntry *e = &_entries[i];
+			File f;
+			if (f.open(e->name, "rb", _res->_fs)) {
+				e->size = f.size();
+				if (_size + e->size > kMaxSize) {
+					break;
+				}
+				e->data = (uint8_t *)malloc(e->size);
+				if (!e->data) {
+					break;
+				}
+				f.read(e->data, e->size);
+				if (f.ioErr()) {
+					free(e->data);
+					e->data = 0;
+					break;
+				}
+			} else if (_res->_archive) {
+				e->data = _res->_archive->loadEntry(e->name, &e->size);
+				if (!e->data) {
+					continue;
+				}
+				e->archiveEntry = true;
+				if (_size + e->size > kMaxSize) {
+					free(e->data);
+					e->data = 0;
+					break;
+				}
+			}
+			_size += e->size;
+		}
+		debug(DBG_RES, "Staged %d bytes for level %d", _size, _level);
+	}
+
+	bool take(const char *name, uint8_t **data, uint32_t *size, bool *archiveEntry) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (int i = 0; i < _entriesCount; ++i) {
+			ResourceStagingEntry *e = &_entries[i];
+			if (e->data && strcmp(e->name, name) == 0) {
+				*data = e->data;
+				*size = e->size;
+				*archiveEntry = e->archiveEntry;
+				e->data = 0;
+				return true;
+			}
+		}
+		return false;
 	}
+};
+
+// reads the files of the next level while the current one is played, the data is kept as is and decoded by Resource::load
+void Resource::stageLevelData(int level, const LoadJob *jobs, int count) {
+	if (_staging) {
+		if (_staging->_level == level) {
+			return;
+		}
+		clearStagedLevelData();
+	}
+	_staging = new ResourceStaging(this, level);
+	for (int i = 0; i < count && i < ResourceStaging::kMaxEntries; ++i) {
+		LoadProc loadProc;
+		getEntryName(_staging->_entries[i].name, sizeof(_staging->_entries[i].name), jobs[i].objName, jobs[i].objType, jobs[i].ext, &loadProc);
+		++_staging->_entriesCount;
+	}
+	_staging->start();
+}
+
+// returns true if the data files staged for that level are used by the next calls to Resource::load
+bool Resource::useStagedLevelData(int level) {
+	if (_staging) {
+		if (_staging->_level == level) {
+			_staging->wait();
+			return true;
+		}
+		if (_staging->_level != level + 1) {
+			// a different level is loaded, the player did not just restart the current one
+			clearStagedLevelData();
+		}
+	}
+	return false;
+}
+
+void Resource::clearStagedLevelData() {
+	delete _staging;
+	_staging = 0;
+}
+
+bool Resource::takeStagedEntry(const char *name, uint8_t **data, uint32_t *size, bool *archiveEntry) {
+	return _staging && _staging->_ready && _staging->take(name, data, size, archiveEntry);
 }
 
 void Resource::load_CT(File *pf) {
 	debug(DBG_RES, "Resource::load_CT()");
 	const int len = pf->size();
-	uint8_t *tmp = (uint8_t *)malloc(len);
+	uint8_t *buf;
+	const uint8_t *tmp = pf->readData(len, &buf);
 	if (!tmp) {
 		error("Unable to allocate CT buffer");
 	} else {
-		pf->read(tmp, len);
 		if (!bytekiller_unpack((uint8_t *)_ctData, sizeof(_ctData), tmp, len)) {
 			error("Bad CRC for collision data");
 		}
-		free(tmp);
+		free(buf);
 	}
 }
 
@@ -968,18 +1237,18 @@ void Resource::load_MAP(File *f) {
 void Resource::load_OBJ(File *f) {
 	debug(DBG_RES, "Resource::load_OBJ()");
 	const int size = f->size();
-	uint8_t *buf = (uint8_t *)malloc(size);
+	uint8_t *tmp;
+	const uint8_t *buf = f->readData(size, &tmp);
 	if (!buf) {
 		error("Unable to allocate OBJ temporary buffer");
 	} else {
-		f->read(buf, size);
 		if (_type == kResourceTypeAmiga || _type == kResourceTypeSega) {
 			decodeOBJ(buf, size);
 		} else {
 			assert(_readUint16(buf) == NUM_OBJECTS);
 			decodeOBJ(buf + 2, size - 2);
 		}
-		free(buf);
+		free(tmp);
 	}
 }
 
@@ -999,11 +1268,11 @@ void Resource::free_OBJ() {
 
 void Resource::load_OBC(File *f) {
 	const int packedSize = f->readUint32BE();
-	uint8_t *packedData = (uint8_t *)malloc(packedSize);
+	uint8_t *packedBuf;
+	const uint8_t *packedData = f->readData(packedSize, &packedBuf);
 	if (!packedData) {
 		error("Unable to allocate OBC temporary buffer 1");
 	}
-	f->read(packedData, packedSize);
 	const int unpackedSize = READ_BE_UINT32(packedData + packedSize - 4);
 	uint8_t *tmp = (uint8_t *)malloc(unpackedSize);
 	if (!tmp) {
@@ -1012,7 +1281,7 @@ void Resource::load_OBC(File *f) {
 	if (!bytekiller_unpack(tmp, unpackedSize, packedData, packedSize)) {
 		error("Bad CRC for compressed object data");
 	}
-	free(packedData);
+	free(packedBuf);
 	decodeOBJ(tmp, unpackedSize);
 	free(tmp);
 }
@@ -1079,13 +1348,13 @@ void Resource::decodeOBJ(const uint8_t *tmp, int size) {
 void Resource::load_PGE(File *f) {
 	debug(DBG_RES, "Resource::load_PGE()");
 	const int size = f->size();
-	uint8_t *tmp = (uint8_t *)malloc(size);
+	uint8_t *buf;
+	const uint8_t *tmp = f->readData(size, &buf);
 	if (!tmp) {
 		error("Unable to allocate PGE temporary buffer");
 	}
-	f->read(tmp, size);
 	decodePGE(tmp, size);
-	free(tmp);
+	free(buf);
 }
 
 void Resource::decodePGE(const uint8_t *p, int size) {
@@ -1150,6 +1419,7 @@ void Resource::load_CMD(File *pf) {
 		error("Unable to allocate CMD buffer");
 	} else {
 		pf->read(_cmd, len);
+		_cmdSize = len;
 	}
 }
 
@@ -1162,6 +1432,7 @@ void Resource::load_POL(File *pf) {
 		error("Unable to allocate POL buffer");
 	} else {
 		pf->read(_pol, len);
+		_polSize = len;
 	}
 }
 
@@ -1169,11 +1440,11 @@ void Resource::load_CMP(File *pf) {
 	free(_pol);
 	free(_cmd);
 	const int len = pf->size();
-	uint8_t *tmp = (uint8_t *)malloc(len);
+	uint8_t *buf;
+	const uint8_t *tmp = pf->readData(len, &buf);
 	if (!tmp) {
 		error("Unable to allocate CMP buffer");
 	}
-	pf->read(tmp, len);
 	struct {
 		int offset, packedSize, size;
 	} data[2];
@@ -1199,6 +1470,7 @@ void Resource::load_CMP(File *pf) {
 	} else if (!bytekiller_unpack(_pol, data[0].size, tmp + data[0].offset, data[0].packedSize)) {
 		error("Bad CRC for cutscene polygon data");
 	}
+	_polSize = data[0].size;
 	_cmd = (uint8_t *)malloc(data[1].size);
 	if (!_cmd) {
 		error("Unable to allocate CMD buffer");
@@ -1208,7 +1480,8 @@ void Resource::load_CMP(File *pf) {
 	} else if (!bytekiller_unpack(_cmd, data[1].size, tmp + data[1].offset, data[1].packedSize)) {
 		error("Bad CRC for cutscene command data");
 	}
-	free(tmp);
+	_cmdSize = data[1].size;
+	free(buf);
 }
 
 void Resource::load_VCE(int num, int segment, uint8_t **buf, uint32_t *bufSize) {
@@ -1255,10 +1528,7 @@ void Resource::load_VCE(int num, int segment, uint8_t **buf, uint32_t *bufSize)
 }
 
 void Resource::load_SPL(File *f) {
-	for (int i = 0; i < _numSfx; ++i) {
-		free(_sfxList[i].data);
-	}
-	free(_sfxList);
+	freeSfx();
 	_numSfx = NUM_SFXS;
 	_sfxList = (SoundFx *)calloc(_numSfx, sizeof(SoundFx));
 	if (!_sfxList) {
@@ -1287,6 +1557,7 @@ void Resource::load_SPL(File *f) {
 		}
 		offset += size;
 	}
+	resampleSfx();
 }
 
 void Resource::load_LEV(File *f) {
@@ -1315,11 +1586,11 @@ void Resource::load_SGD(File *f) {
 	f->seek(len - 4);
 	int size = f->readUint32BE();
 	f->seek(0);
-	uint8_t *tmp = (uint8_t *)malloc(len);
+	uint8_t *buf;
+	const uint8_t *tmp = f->readData(len, &buf);
 	if (!tmp) {
 		error("Unable to allocate SGD temporary buffer");
 	}
-	f->read(tmp, len);
 	_sgd = (uint8_t *)malloc(size);
 	if (!_sgd) {
 		error("Unable to allocate SGD buffer");
@@ -1327,7 +1598,7 @@ void Resource::load_SGD(File *f) {
 	if (!bytekiller_unpack(_sgd, size, tmp, len)) {
 		error("Bad CRC for SGD data");
 	}
-	free(tmp);
+	free(buf);
 }
 
 void Resource::load_BNQ(File *f) {
@@ -1346,11 +1617,11 @@ void Resource::load_SPM(File *f) {
 	f->seek(len - 4);
 	const uint32_t size = f->readUint32BE();
 	f->seek(0);
-	uint8_t *tmp = (uint8_t *)malloc(len);
+	uint8_t *buf;
+	const uint8_t *tmp = f->readData(len, &buf);
 	if (!tmp) {
 		error("Unable to allocate SPM temporary buffer");
 	}
-	f->read(tmp, len);
 	if (size == kPersoDatSize) {
 		_spr1 = (uint8_t *)malloc(size);
 		if (!_spr1) {
@@ -1373,12 +1644,18 @@ void Resource::load_SPM(File *f) {
 			_sprData[i] = _spr1 + offset;
 		}
 	}
-	free(tmp);
+	free(buf);
 }
 
 void Resource::clearBankData() {
+	if (_bankHits + _bankMisses != 0) {
+		debug(DBG_RES, "Bank data cache: %d hits, %d misses, %d evictions", _bankHits, _bankMisses, _bankEvictions);
+	}
+	_bankHits = _bankMisses = _bankEvictions = 0;
+	_bankUseCounter = 0;
 	_bankBuffersCount = 0;
 	_bankDataHead = _bankData;
+	memset(_bankIndex, 0, sizeof(_bankIndex));
 }
 
 int Resource::getBankDataSize(uint16_t num) {
@@ -1409,13 +1686,87 @@ int Resource::getBankDataSize(uint16_t num) {
 	return len * 32;
 }
 
-uint8_t *Resource::findBankData(uint16_t num) {
+// the DOS .BNQ banks are cached along with the level banks, bit 15 tells them apart
+uint16_t Resource::getBankKey(uint16_t num) const {
+	return (_mbk == _bnq) ? (num | 0x8000) : num;
+}
+
+static int getBankIndexPos(uint16_t key) {
+	const int num = key & 0x7FFF;
+	if (num >= Resource::kBankIndexSize / 2) {
+		return -1;
+	}
+	return ((key & 0x8000) ? Resource::kBankIndexSize / 2 : 0) + num;
+}
+
+void Resource::updateBankIndex() {
+	memset(_bankIndex, 0, sizeof(_bankIndex));
+	for (int i = 0; i < _bankBuffersCount; ++i) {
+		const int pos = getBankIndexPos(_bankBuffers[i].entryNum);
+		if (pos >= 0) {
+			_bankIndex[pos] = i + 1;
+		}
+	}
+}
+
+// evicts the least recently used banks and compacts the remaining ones until 'size' bytes are available at _bankDataHead
+uint8_t *Resource::allocBankData(int size) {
+	assert(size <= kBankDataSize);
+	if (_bankBuffersCount < NUM_BANK_BUFFERS && _bankDataTail - _bankDataHead >= size) {
+		return _bankDataHead;
+	}
+	int used = 0;
 	for (int i = 0; i < _bankBuffersCount; ++i) {
-		if (_bankBuffers[i].entryNum == num) {
-			return _bankBuffers[i].ptr;
+		used += _bankBuffers[i].size;
+	}
+	while (_bankBuffersCount >= NUM_BANK_BUFFERS || kBankDataSize - used < size) {
+		int lru = 0;
+		for (int i = 1; i < _bankBuffersCount; ++i) {
+			if (_bankBuffers[i].lastUse < _bankBuffers[lru].lastUse) {
+				lru = i;
+			}
+		}
+		used -= _bankBuffers[lru].size;
+		--_bankBuffersCount;
+		memmove(&_bankBuffers[lru], &_bankBuffers[lru + 1], (_bankBuffersCount - lru) * sizeof(BankSlot));
+		++_bankEvictions;
+	}
+	if (_bankDataTail - _bankDataHead < size) {
+		uint8_t *p = _bankData;
+		for (int i = 0; i < _bankBuffersCount; ++i) {
+			if (_bankBuffers[i].ptr != p) {
+				memmove(p, _bankBuffers[i].ptr, _bankBuffers[i].size);
+				_bankBuffers[i].ptr = p;
+			}
+			p += _bankBuffers[i].size;
+		}
+		_bankDataHead = p;
+	}
+	updateBankIndex();
+	return _bankDataHead;
+}
+
+uint8_t *Resource::findBankData(uint16_t num) {
+	const uint16_t key = getBankKey(num);
+	int slot = -1;
+	const int pos = getBankIndexPos(key);
+	if (pos >= 0) {
+		slot = _bankIndex[pos] - 1;
+	} else {
+		for (int i = 0; i < _bankBuffersCount; ++i) {
+			if (_bankBuffers[i].entryNum == key) {
+				slot = i;
+				break;
+			}
 		}
 	}
-	return 0;
+	if (slot < 0) {
+		++_bankMisses;
+		return 0;
+	}
+	++_bankHits;
+	_bankBuffers[slot].lastUse = ++_bankUseCounter;
+	return _bankBuffers[slot].ptr;
 }
 
 uint8_t *Resource::loadBankData(uint16_t num) {
@@ -1431,14 +1782,18 @@ uint8_t *Resource::loadBankData(uint16_t num) {
 		warning("Invalid bank data %d", num);
 		return _bankDataHead;
 	}
-	const int avail = _bankDataTail - _bankDataHead;
-	if (avail < size) {
-		clearBankData();
-	}
+	allocBankData(size);
 	assert(_bankDataHead + size <= _bankDataTail);
 	assert(_bankBuffersCount < (int)ARRAYSIZE(_bankBuffers));
-	_bankBuffers[_bankBuffersCount].entryNum = num;
-	_bankBuffers[_bankBuffersCount].ptr = _bankDataHead;
+	BankSlot *slot = &_bankBuffers[_bankBuffersCount];
+	slot->entryNum = getBankKey(num);
+	slot->ptr = _bankDataHead;
+	slot->size = size;
+	slot->lastUse = ++_bankUseCounter;
+	const int pos = getBankIndexPos(slot->entryNum);
+	if (pos >= 0) {
+		_bankIndex[pos] = _bankBuffersCount + 1;
+	}
 	++_bankBuffersCount;
 	const uint8_t *data = _mbk + dataOffset;
 	const int count = READ_BE_UINT16(ptr + 4);
@@ -1504,6 +1859,7 @@ void Resource::PC98_loadSounds() {
 			}
 			decodeSfxFibonacci(sfx, f);
 		}
+		resampleSfx();
 	}
 }
 
@@ -1541,7 +1897,14 @@ uint8_t *Resource::decodeResourceMacData(const ResourceMacEntry *entry, bool dec
 	_resourceMacDataSize = _mac->_f.readUint32BE();
 	uint8_t *data = 0;
 	if (decompressLzss) {
-		data = decodeLzss(_mac->_f, _resourceMacDataSize);
+		// the whole entry is read, or mapped, and decoded from memory
+		const uint32_t size = _resourceMacDataSize;
+		uint8_t *buf;
+		const uint8_t *p = _mac->_f.readData(size, &buf);
+		if (p) {
+			data = decodeLzss(p, size, _resourceMacDataSize);
+			free(buf);
+		}
 		if (!data) {
 			error("Failed to decompress '%s'", entry->name);
 		}
@@ -1836,6 +2199,7 @@ void Resource::MAC_loadCutscene(const char *cutscene) {
 		return;
 	}
 	_cmd = decodeResourceMacData(cmdEntry, true);
+	_cmdSize = _resourceMacDataSize;
 
 	snprintf(name, sizeof(name), "%s polygons", cutscene);
 	stringLowerCase(name);
@@ -1844,6 +2208,7 @@ void Resource::MAC_loadCutscene(const char *cutscene) {
 		return;
 	}
 	_pol = decodeResourceMacData(polEntry, true);
+	_polSize = _resourceMacDataSize;
 }
 
 void Resource::MAC_loadCutsceneText() {
@@ -1898,4 +2263,5 @@ void Resource::MAC_loadSounds() {
 			}
 		}
 	}
+	resampleSfx();
 }
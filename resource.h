@@ -11,10 +11,12 @@
 #include "resource_aba.h"
 #include "resource_mac.h"
 #include "resource_paq.h"
+#include "unpack_cache.h"
 
 struct DecodeBuffer;
 struct File;
 struct FileSystem;
+struct ResourceStaging;
 
 struct LocaleData {
 	enum Id {
@@ -115,7 +117,16 @@ struct Resource {
 	enum {
 		kPaulaFreq = 3546897,
 		kClutSize = 1024,
-		kScratchBufferSize = 320 * 224 + 1024
+		kScratchBufferSize = 320 * 224 + 1024,
+		kMaxLoadThreads = 4,
+		kBankDataSize = 0x7000,
+		kBankIndexSize = 512 // level banks and DOS .BNQ banks, numbers below 256
+	};
+
+	struct LoadJob {
+		const char *objName;
+		int objType;
+		const char *ext;
 	};
 
 	static const uint16_t _voicesOffsetsTable[];
@@ -132,6 +143,8 @@ struct Resource {
 	ResourceAba *_aba;
 	ResourceMac *_mac;
 	ResourcePaq *_paq;
+	UnpackCache _unpackCache;
+	ResourceStaging *_staging; // next level files read in the background
 	uint16_t (*_readUint16)(const void *);
 	uint32_t (*_readUint32)(const void *);
 	bool _hasSeqData;
@@ -163,8 +176,11 @@ struct Resource {
 	uint8_t *_scratchBuffer;
 	SoundFx *_sfxList;
 	uint8_t _numSfx;
+	int _sfxOutputRate;
 	uint8_t *_cmd;
+	uint32_t _cmdSize;
 	uint8_t *_pol;
+	uint32_t _polSize;
 	uint8_t *_cineStrings[NUM_CUTSCENE_TEXTS];
 	uint8_t *_cine_off;
 	uint8_t *_cine_txt;
@@ -173,8 +189,11 @@ struct Resource {
 	uint8_t *_bankData;
 	uint8_t *_bankDataHead;
 	uint8_t *_bankDataTail;
-	BankSlot _bankBuffers[NUM_BANK_BUFFERS];
+	BankSlot _bankBuffers[NUM_BANK_BUFFERS]; // sorted by address in _bankData
 	int _bankBuffersCount;
+	uint8_t _bankIndex[kBankIndexSize]; // position in _bankBuffers plus one, 0 if not loaded
+	uint32_t _bankUseCounter;
+	uint32_t _bankHits, _bankMisses, _bankEvictions;
 	uint8_t *_dem;
 	int _demLen;
 	uint32_t _resourceMacDataSize;
@@ -204,6 +223,8 @@ struct Resource {
 	void clearLevelRes();
 	void load_DEM(const char *filename);
 	void load_FIB(const char *fileName);
+	void resampleSfx();
+	void freeSfx();
 	void load_SPL_demo();
 	void load_MAP_menu(const char *fileName, uint8_t *dstPtr);
 	void load_PAL_menu(const char *fileName, uint8_t *dstPtr);
@@ -217,6 +238,12 @@ struct Resource {
 	void free_CreditsCrd();
 	void unload(int objType);
 	void load(const char *objName, int objType, const char *ext = 0);
+	void loadJobs(const LoadJob *jobs, int count);
+	void getEntryName(char *entryName, int size, const char *objName, int objType, const char *ext, LoadProc *loadProc);
+	void stageLevelData(int level, const LoadJob *jobs, int count);
+	bool useStagedLevelData(int level);
+	void clearStagedLevelData();
+	bool takeStagedEntry(const char *name, uint8_t **data, uint32_t *size, bool *archiveEntry);
 	void load_CT(File *pf);
 	void load_FNT(File *pf);
 	void load_MBK(File *pf);
@@ -332,6 +359,9 @@ struct Resource {
 	}
 	void clearBankData();
 	int getBankDataSize(uint16_t num);
+	uint16_t getBankKey(uint16_t num) const;
+	void updateBankIndex();
+	uint8_t *allocBankData(int size);
 	uint8_t *findBankData(uint16_t num);
 	uint8_t *loadBankData(uint16_t num);
 
@@ -1,10 +1,11 @@
 
 #include "resource_aba.h"
 #include "unpack.h"
+#include "unpack_cache.h"
 #include "util.h"
 
-ResourceAba::ResourceAba(FileSystem *fs)
-	: _fs(fs) {
+ResourceAba::ResourceAba(FileSystem *fs, UnpackCache *cache)
+	: _fs(fs), _cache(cache) {
 	_filesCount = 0;
 	_entries = 0;
 	_entriesCount = 0;
@@ -49,6 +50,7 @@ void ResourceAba::readEntries(const char *aba) {
 			nextOffset = _entries[j].offset + _entries[j].compressedSize;
 		}
 		qsort(_entries, _entriesCount, sizeof(ResourceAbaEntry), compareAbaEntry);
+		_fileNames[_filesCount] = aba;
 		++_filesCount;
 	}
 }
@@ -66,27 +68,50 @@ uint8_t *ResourceAba::loadEntry(const char *name, uint32_t *size) {
 		if (size) {
 			*size = e->size;
 		}
-		uint8_t *tmp = (uint8_t *)malloc(e->compressedSize);
-		if (!tmp) {
-			error("Failed to allocate %d bytes", e->compressedSize);
+		dst = (uint8_t *)malloc(e->size);
+		if (!dst) {
+			error("Failed to allocate %d bytes", e->size);
 			return 0;
 		}
-		_f[e->fileIndex].seek(e->offset);
-		_f[e->fileIndex].read(tmp, e->compressedSize);
+		File &f = _f[e->fileIndex];
+		// the file position is shared by the threads loading the level resources
+		std::unique_lock<std::mutex> lock(_readMutex);
+		f.seek(e->offset);
 		if (e->compressedSize == e->size) {
-			dst = tmp;
+			f.read(dst, e->size);
 		} else {
-			dst = (uint8_t *)malloc(e->size);
-			if (!dst) {
-				error("Failed to allocate %d bytes", e->size);
-				free(tmp);
+			// unpack from the mapped archive when possible
+			uint8_t *buf;
+			const uint8_t *tmp = f.readData(e->compressedSize, &buf);
+			lock.unlock();
+			if (!tmp) {
+				error("Failed to allocate %d bytes", e->compressedSize);
+				free(dst);
 				return 0;
 			}
+			UnpackCacheKey key;
+			if (_cache->_directory) {
+				UnpackCache::makeKey(&key, _fileNames[e->fileIndex], e->name, tmp, e->compressedSize, e->size);
+				uint32_t cachedSize;
+				uint8_t *cached = _cache->load(key, &cachedSize);
+				if (cached) {
+					if (cachedSize == e->size) {
+						free(buf);
+						free(dst);
+						return cached;
+					}
+					// the cache files are not trusted, unpack the entry again
+					warning("Unpack cache size %d does not match '%s' size %d", cachedSize, name, e->size);
+					free(cached);
+				}
+			}
 			const bool ret = bytekiller_unpack(dst, e->size, tmp, e->compressedSize);
 			if (!ret) {
 				error("Bad CRC for '%s'", name);
+			} else if (_cache->_directory) {
+				_cache->save(key, dst, e->size);
 			}
-			free(tmp);
+			free(buf);
 		}
 	}
 	return dst;
@@ -2,9 +2,11 @@
 #ifndef RESOURCE_ABA_H__
 #define RESOURCE_ABA_H__
 
+#include <mutex>
 #include "file.h"
 
 struct FileSystem;
+struct UnpackCache;
 
 struct ResourceAbaEntry {
 	char name[14];
@@ -20,11 +22,14 @@ struct ResourceAba: ResourceArchive {
 
 	FileSystem *_fs;
 	File _f[3];
+	const char *_fileNames[3];
 	int _filesCount;
 	ResourceAbaEntry *_entries;
 	int _entriesCount;
+	UnpackCache *_cache;
+	std::mutex _readMutex;
 
-	ResourceAba(FileSystem *fs);
+	ResourceAba(FileSystem *fs, UnpackCache *cache);
 	~ResourceAba();
 
 	void readEntries(const char *aba);
@@ -1,12 +1,13 @@
 
 #include "resource_paq.h"
 #include "unpack.h"
+#include "unpack_cache.h"
 #include "util.h"
 
 static const int DEFAULT_READ_BUFFER_SIZE = 8192;
 
-ResourcePaq::ResourcePaq(FileSystem *fs)
-	: _fs(fs), _filesCount(0) {
+ResourcePaq::ResourcePaq(FileSystem *fs, UnpackCache *cache)
+	: _fs(fs), _filesCount(0), _cache(cache) {
 	_readBufferSize = DEFAULT_READ_BUFFER_SIZE;
 	_readBuffer = (uint8_t *)malloc(_readBufferSize);
 	if (!_readBuffer) {
@@ -65,6 +66,7 @@ uint8_t *ResourcePaq::loadEntry(const char *name, uint32_t *size) {
 		warning("PAQ entry '%s' not found", name);
 		return 0;
 	}
+	std::lock_guard<std::mutex> lock(_mutex);
 	File &f = _f[e->paq];
 	debug(DBG_PAQ, "seeking to entry %d file %s", e->num, _names[e->paq]);
 	f.seek(e->num * 12);
@@ -72,17 +74,24 @@ uint8_t *ResourcePaq::loadEntry(const char *name, uint32_t *size) {
 	const uint32_t compressed   = f.readUint32LE();
 	const uint32_t uncompressed = f.readUint32LE();
 	debug(DBG_PAQ, "0x%x compressed %d uncompressed %d", offset, compressed, uncompressed);
-	if (size) {
-		*size = uncompressed;
-	}
-	uint8_t *dst = (uint8_t *)malloc(uncompressed);
-	if (!dst) {
-		warning("Failed to allocate %d bytes to uncompress PAQ entry", uncompressed);
-		return 0;
-	}
 	f.seek(offset);
 	if (compressed == uncompressed) {
+		uint8_t *dst = (uint8_t *)malloc(uncompressed);
+		if (!dst) {
+			warning("Failed to allocate %d bytes to read PAQ entry", uncompressed);
+			return 0;
+		}
 		f.read(dst, uncompressed);
+		if (size) {
+			*size = uncompressed;
+		}
+		return dst;
+	}
+	uint32_t mappedSize;
+	const uint8_t *src = f.getData(&mappedSize);
+	if (src && offset <= mappedSize && compressed <= mappedSize - offset) {
+		// unpack from the mapped archive
+		src += offset;
 	} else {
 		if (compressed > _readBufferSize) {
 			uint8_t *buffer = (uint8_t *)realloc(_readBuffer, compressed);
@@ -94,54 +103,97 @@ uint8_t *ResourcePaq::loadEntry(const char *name, uint32_t *size) {
 			_readBufferSize = compressed;
 		}
 		f.read(_readBuffer, compressed);
-		pc98_unpack(dst, uncompressed, _readBuffer, compressed);
-		const char *ext = strrchr(name, '.');
-		if (ext && strcasecmp(ext + 1, "PGE") == 0) {
-			// PGE files contain x86 code to decompresses themselves.
-			// Skip that x86 section and decompress the payload directly.
-			const uint16_t pge_size = dst[10] | (dst[11] << 8);
-			const uint16_t pge_offs = dst[17] | (dst[18] << 8);
-			debug(DBG_PAQ, "PGE data size %d offset 0x%x", pge_size, pge_offs);
-			uint8_t *pge_dst = (uint8_t *)malloc(pge_size);
-			if (!pge_dst) {
-				warning("Failed to allocate %d bytes to uncompress PGE entry", pge_size);
-				free(dst);
-				return 0;
+		src = _readBuffer;
+	}
+	UnpackCacheKey key;
+	uint32_t dstSize;
+	if (_cache->_directory) {
+		UnpackCache::makeKey(&key, _names[e->paq], name, src, compressed, uncompressed);
+		uint8_t *dst = _cache->load(key, &dstSize);
+		if (dst) {
+			if (size) {
+				*size = dstSize;
 			}
-			pc98_unpack(pge_dst, pge_size, dst + pge_offs, uncompressed - pge_offs);
-			assert(pge_size > 0x5f);
-			memmove(pge_dst, pge_dst + 0x5f, pge_size - 0x5f);
-			*size = pge_size - 0x5f;
+			return dst;
+		}
+	}
+	uint8_t *dst = unpackEntry(name, src, compressed, uncompressed, &dstSize);
+	if (dst) {
+		if (_cache->_directory) {
+			_cache->save(key, dst, dstSize);
+		}
+		if (size) {
+			*size = dstSize;
+		}
+	}
+	return dst;
+}
+
+uint8_t *ResourcePaq::unpackEntry(const char *name, const uint8_t *src, uint32_t compressed, uint32_t uncompressed, uint32_t *size) {
+	uint8_t *dst = (uint8_t *)malloc(uncompressed);
+	if (!dst) {
+		warning("Failed to allocate %d bytes to uncompress PAQ entry", uncompressed);
+		return 0;
+	}
+	*size = uncompressed;
+	pc98_unpack(dst, uncompressed, src, compressed);
+	const char *ext = strrchr(name, '.');
+	if (ext && strcasecmp(ext + 1, "PGE") == 0) {
+		// PGE files contain x86 code to decompresses themselves.
+		// Skip that x86 section and decompress the payload directly.
+		const uint16_t pge_size = dst[10] | (dst[11] << 8);
+		const uint16_t pge_offs = dst[17] | (dst[18] << 8);
+		debug(DBG_PAQ, "PGE data size %d offset 0x%x", pge_size, pge_offs);
+		uint8_t *pge_dst = (uint8_t *)malloc(pge_size);
+		if (!pge_dst) {
+			warning("Failed to allocate %d bytes to uncompress PGE entry", pge_size);
 			free(dst);
-			dst = pge_dst;
-		} else if (strcasecmp(name, "GLOBAL.ICN") == 0) {
-			// DEMO entry number 3 contains the icons, with self decompressing x86 code,
-			// data being compressed 4 times...
-			int bufsize = uncompressed;
-			static const int kBufferSize = 16 * 1024;
-			uint8_t *buf = dst;
-			uint8_t *tmp = (uint8_t *)malloc(kBufferSize);
-			if (!tmp) {
-				warning("Failed to allocate %d bytes to uncompress GLOBAL.ICN", kBufferSize);
+			return 0;
+		}
+		pc98_unpack(pge_dst, pge_size, dst + pge_offs, uncompressed - pge_offs);
+		assert(pge_size > 0x5f);
+		memmove(pge_dst, pge_dst + 0x5f, pge_size - 0x5f);
+		*size = pge_size - 0x5f;
+		free(dst);
+		dst = pge_dst;
+	} else if (strcasecmp(name, "GLOBAL.ICN") == 0) {
+		// DEMO entry number 3 contains the icons, with self decompressing x86 code,
+		// data being compressed 4 times...
+		int bufsize = uncompressed;
+		static const int kBufferSize = 16 * 1024;
+		uint8_t *buf = dst;
+		uint8_t *tmp = (uint8_t *)malloc(kBufferSize);
+		if (!tmp) {
+			warning("Failed to allocate %d bytes to uncompress GLOBAL.ICN", kBufferSize);
+			free(dst);
+			return 0;
+		}
+		while (1) {
+			const uint16_t icn_size   = (buf[8]  << 8) | buf[7];
+			const uint16_t icn_offset = (buf[15] << 8) | buf[14];
+			if (icn_offset != 0x112) {
+				memmove(tmp, tmp + 0x7D0, kBufferSize - 0x7D0);
+				*size = kBufferSize - 0x7D0;
 				free(dst);
-				return 0;
+				return tmp;
 			}
-			while (1) {
-				const uint16_t icn_size   = (buf[8]  << 8) | buf[7];
-				const uint16_t icn_offset = (buf[15] << 8) | buf[14];
-				if (icn_offset != 0x112) {
-					memmove(tmp, tmp + 0x7D0, kBufferSize - 0x7D0);
-					*size = kBufferSize - 0x7D0;
+			assert(bufsize <= kBufferSize);
+			pc98_unpack(tmp, icn_size, buf + icn_offset, bufsize - icn_offset);
+			// the read buffer is not filled when the PAQ is mapped, it can be smaller than the stage
+			if (_readBufferSize < icn_size) {
+				uint8_t *buffer = (uint8_t *)realloc(_readBuffer, icn_size);
+				if (!buffer) {
+					warning("Failed to allocate %d bytes to uncompress GLOBAL.ICN", icn_size);
+					free(tmp);
 					free(dst);
-					return tmp;
+					return 0;
 				}
-				assert(bufsize <= kBufferSize);
-				pc98_unpack(tmp, icn_size, buf + icn_offset, bufsize - icn_offset);
-				assert(_readBufferSize >= icn_size);
-				memcpy(_readBuffer, tmp, icn_size);
-				buf = _readBuffer;
-				bufsize = icn_size;
+				_readBuffer = buffer;
+				_readBufferSize = icn_size;
 			}
+			memcpy(_readBuffer, tmp, icn_size);
+			buf = _readBuffer;
+			bufsize = icn_size;
 		}
 	}
 	return dst;
@@ -2,9 +2,11 @@
 #ifndef RESOURCE_PAQ_H__
 #define RESOURCE_PAQ_H__
 
+#include <mutex>
 #include "file.h"
 
 struct FileSystem;
+struct UnpackCache;
 
 struct ResourcePaqEntry {
 	uint32_t hash;
@@ -24,13 +26,16 @@ struct ResourcePaq: ResourceArchive {
 	int _filesCount;
 	uint8_t *_readBuffer;
 	uint32_t _readBufferSize;
+	UnpackCache *_cache;
+	std::mutex _mutex; // the files position and the read buffer are shared
 
-	ResourcePaq(FileSystem *fs);
+	ResourcePaq(FileSystem *fs, UnpackCache *cache);
 	virtual ~ResourcePaq();
 
 	bool open();
 
 	const ResourcePaqEntry *findEntry(const char *name) const;
+	uint8_t *unpackEntry(const char *name, const uint8_t *src, uint32_t compressed, uint32_t uncompressed, uint32_t *size);
 
 	virtual bool hasEntry(const char *name) const { return hasEntry(name) != 0; }
 	virtual uint8_t *loadEntry(const char *name, uint32_t *size = 0);
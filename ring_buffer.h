@@ -0,0 +1,109 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef RING_BUFFER_H__
+#define RING_BUFFER_H__
+
+#include <atomic>
+#include "intern.h"
+
+// Single producer, single consumer lock-free queue. Only one thread may call
+// write() and only one other thread may call read(), no allocation is done
+// after init().
+
+template<typename T>
+struct RingBuffer {
+	T *_data;
+	int _size;
+	std::atomic<int> _readPos;
+	std::atomic<int> _writePos;
+
+	RingBuffer()
+		: _data(0), _size(0), _readPos(0), _writePos(0) {
+	}
+	~RingBuffer() {
+		free(_data);
+	}
+
+	bool init(int capacity) {
+		free(_data);
+		// one slot is kept empty to distinguish between full and empty
+		_size = capacity + 1;
+		_data = (T *)malloc(_size * sizeof(T));
+		reset();
+		return _data != 0;
+	}
+	// not thread-safe, the producer and consumer must be stopped
+	void reset() {
+		_readPos.store(0, std::memory_order_relaxed);
+		_writePos.store(0, std::memory_order_relaxed);
+	}
+	int available() const {
+		const int r = _readPos.load(std::memory_order_relaxed);
+		const int w = _writePos.load(std::memory_order_acquire);
+		return (w >= r) ? (w - r) : (w + _size - r);
+	}
+	int space() const {
+		const int r = _readPos.load(std::memory_order_acquire);
+		const int w = _writePos.load(std::memory_order_relaxed);
+		return _size - 1 - ((w >= r) ? (w - r) : (w + _size - r));
+	}
+	int write(const T *src, int count) {
+		count = MIN(count, space());
+		int w = _writePos.load(std::memory_order_relaxed);
+		for (int i = 0; i < count; ++i) {
+			_data[w] = src[i];
+			if (++w == _size) {
+				w = 0;
+			}
+		}
+		_writePos.store(w, std::memory_order_release);
+		return count;
+	}
+	int read(T *dst, int count) {
+		count = MIN(count, available());
+		int r = _readPos.load(std::memory_order_relaxed);
+		for (int i = 0; i < count; ++i) {
+			dst[i] = _data[r];
+			if (++r == _size) {
+				r = 0;
+			}
+		}
+		_readPos.store(r, std::memory_order_release);
+		return count;
+	}
+	// consumer side, the entry stays queued until pop() is called
+	const T *front() const {
+		const int r = _readPos.load(std::memory_order_relaxed);
+		if (r == _writePos.load(std::memory_order_acquire)) {
+			return 0;
+		}
+		return &_data[r];
+	}
+	void pop() {
+		int r = _readPos.load(std::memory_order_relaxed);
+		if (++r == _size) {
+			r = 0;
+		}
+		_readPos.store(r, std::memory_order_release);
+	}
+	// producer side, the queued entries are only rewritten by the producer
+	template<typename Pred>
+	bool findQueued(Pred pred) const {
+		const int w = _writePos.load(std::memory_order_relaxed);
+		for (int r = _readPos.load(std::memory_order_acquire); r != w; ) {
+			if (pred(_data[r])) {
+				return true;
+			}
+			if (++r == _size) {
+				r = 0;
+			}
+		}
+		return false;
+	}
+};
+
+#endif // RING_BUFFER_H__
@@ -252,14 +252,15 @@ static void scale4x(uint32_t *dst, int dstPitch, const uint32_t *src, int srcPit
 	if (buf.size < size) {
 		free(buf.ptr);
 		buf.size = size;
-		buf.w = w * 2;
-		buf.h = h * 2;
-		buf.pitch = buf.w;
 		buf.ptr = (uint32_t *)malloc(buf.size);
 		if (!buf.ptr) {
 			error("Unable to allocate scale4x intermediate buffer");
 		}
 	}
+	// the dimensions can change between calls when scaling partial screen updates
+	buf.w = w * 2;
+	buf.h = h * 2;
+	buf.pitch = buf.w;
 	scale2x(buf.ptr, buf.pitch, src, srcPitch, w, h);
 	scale2x(dst, dstPitch, buf.ptr, buf.pitch, buf.w, buf.h);
 }
@@ -4,6 +4,7 @@
  * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
+#include <thread>
 #include "file.h"
 #include "fs.h"
 #include "mixer.h"
@@ -16,6 +17,14 @@ bool SeqDemuxer::open(File *f) {
 	_fileSize = _f->size();
 	memset(_buffers, 0, sizeof(_buffers));
 	_frameOffset = 0;
+	_readAheadBuffer = (uint8_t *)malloc(kReadAheadFrames * kFrameSize);
+	if (!_readAheadBuffer) {
+		warning("Unable to allocate SEQ read-ahead buffer");
+		return false;
+	}
+	_readAheadOffset = 0;
+	_readAheadSize = 0;
+	_frameData = 0;
 	return readHeader();
 }
 
@@ -25,16 +34,24 @@ void SeqDemuxer::close() {
 		free(_buffers[i].data);
 	}
 	memset(_buffers, 0, sizeof(_buffers));
+	free(_readAheadBuffer);
+	_readAheadBuffer = 0;
+	_frameData = 0;
 }
 
 bool SeqDemuxer::readHeader() {
+	if (!loadFrame(0)) {
+		return false;
+	}
+	const uint8_t *p = _frameData;
 	for (int i = 0; i < 256; i += 4) {
-		if (_f->readUint32LE() != 0) {
+		if (READ_LE_UINT32(p + i) != 0) {
 			return false;
 		}
 	}
+	p += 256;
 	for (int i = 0; i < kBuffersCount; ++i) {
-		const int size = _f->readUint16LE();
+		const int size = READ_LE_UINT16(p); p += 2;
 		if (size != 0) {
 			_buffers[i].size = 0;
 			_buffers[i].avail = size;
@@ -50,21 +67,47 @@ bool SeqDemuxer::readHeader() {
 	return true;
 }
 
+bool SeqDemuxer::loadFrame(int offset) {
+	if (offset < _readAheadOffset || offset + kFrameSize > _readAheadOffset + _readAheadSize) {
+		// read the next frames with a single call
+		const int size = MIN(kReadAheadFrames * kFrameSize, _fileSize - offset);
+		if (size <= 0) {
+			return false;
+		}
+		_f->seek(offset);
+		_f->read(_readAheadBuffer, size);
+		if (_f->ioErr()) {
+			return false;
+		}
+		if (size < kFrameSize) {
+			// truncated last frame
+			memset(_readAheadBuffer + size, 0, kFrameSize - size);
+		}
+		_readAheadOffset = offset;
+		_readAheadSize = MAX<int>(size, kFrameSize);
+	}
+	_frameData = _readAheadBuffer + (offset - _readAheadOffset);
+	return true;
+}
+
 bool SeqDemuxer::readFrameData() {
 	_frameOffset += kFrameSize;
 	if (_frameOffset >= _fileSize) {
 		return false;
 	}
-	_f->seek(_frameOffset);
-	_audioDataOffset = _f->readUint16LE();
-	_paletteDataOffset = _f->readUint16LE();
+	if (!loadFrame(_frameOffset)) {
+		return false;
+	}
+	const uint8_t *p = _frameData;
+	_audioDataOffset = READ_LE_UINT16(p); p += 2;
+	_paletteDataOffset = READ_LE_UINT16(p); p += 2;
 	uint8_t num[4];
 	for (int i = 0; i < 4; ++i) {
-		num[i] = _f->readByte();
+		num[i] = *p++;
 	}
 	uint16_t offsets[4];
 	for (int i = 0; i < 4; ++i) {
-		offsets[i] = _f->readUint16LE();
+		offsets[i] = READ_LE_UINT16(p); p += 2;
 	}
 	for (int i = 0; i < 3; ++i) {
 		if (offsets[i] != 0) {
@@ -81,14 +124,14 @@ bool SeqDemuxer::readFrameData() {
 	} else {
 		_videoData = -1;
 	}
-	return !_f->ioErr();
+	return true;
 }
 
 void SeqDemuxer::fillBuffer(int num, int offset, int size) {
 	assert(num < kBuffersCount);
-	_f->seek(_frameOffset + offset);
+	assert(offset >= 0 && offset + size <= kFrameSize);
 	assert(_buffers[num].size + size <= _buffers[num].avail);
-	_f->read(_buffers[num].data + _buffers[num].size, size);
+	memcpy(_buffers[num].data + _buffers[num].size, _frameData + offset, size);
 	_buffers[num].size += size;
 }
 
@@ -97,14 +140,15 @@ void SeqDemuxer::clearBuffer(int num) {
 }
 
 void SeqDemuxer::readPalette(uint8_t *dst) {
-	_f->seek(_frameOffset + _paletteDataOffset);
-	_f->read(dst, 256 * 3);
+	assert(_paletteDataOffset + 256 * 3 <= kFrameSize);
+	memcpy(dst, _frameData + _paletteDataOffset, 256 * 3);
 }
 
 void SeqDemuxer::readAudio(int16_t *dst) {
-	_f->seek(_frameOffset + _audioDataOffset);
+	assert(_audioDataOffset + kAudioBufferSize * 2 <= kFrameSize);
+	const uint8_t *p = _frameData + _audioDataOffset;
 	for (int i = 0; i < kAudioBufferSize; ++i) {
-		dst[i] = _f->readUint16BE();
+		dst[i] = READ_BE_UINT16(p); p += 2;
 	}
 }
 
@@ -216,9 +260,9 @@ static const uint8_t *decodeSeqOp3(uint8_t *dst, int pitch, const uint8_t *src)
 
 SeqPlayer::SeqPlayer(SystemStub *stub, Mixer *mixer)
 	: _stub(stub), _buf(0), _mix(mixer) {
-	_soundQueuePreloadSize = 0;
-	_soundQueue = 0;
-	_soundQueueTail = 0;
+	_soundQueuePreloaded = false;
+	_frames = 0;
+	_decodeBuffer = 0;
 }
 
 SeqPlayer::~SeqPlayer() {
@@ -226,78 +270,65 @@ SeqPlayer::~SeqPlayer() {
 
 void SeqPlayer::play(File *f) {
 	if (_demux.open(f)) {
+		// the preloaded frames and two audio callback periods, converted to the SEQ sample rate
+		const uint32_t outputRate = _mix->getSampleRate();
+		const int periodSize = (int)(((uint64_t)_stub->getOutputBufferSize() * kSoundSampleRate + outputRate - 1) / outputRate);
+		const int soundQueueSize = kSoundPreloadSize * SeqDemuxer::kAudioBufferSize + 2 * periodSize;
+		_frames = (Frame *)malloc(kFrameQueueSize * sizeof(Frame));
+		_decodeBuffer = (uint8_t *)calloc(kVideoWidth * kVideoHeight, 1);
+		if (!_frames || !_decodeBuffer || !_soundQueue.init(soundQueueSize)) {
+			warning("Unable to allocate SEQ frame and sound queues");
+			free(_frames);
+			_frames = 0;
+			free(_decodeBuffer);
+			_decodeBuffer = 0;
+			_demux.close();
+			return;
+		}
+		_framesHead = _framesCount = 0;
+		_decodeStop = _decodeEnd = false;
+		std::thread decodeThread(decodeThreadProc, this);
 		uint8_t palette[256 * 3];
 		_stub->getPalette(palette, 256);
+		_soundQueuePreloaded = false;
 		_mix->setPremixHook(mixCallback, this);
 		memset(_buf, 0, 256 * 224);
 		bool clearScreen = true;
+		uint32_t nextFrameTimeStamp = _stub->getTimeStamp();
 		while (true) {
-			const uint32_t nextFrameTimeStamp = _stub->getTimeStamp() + 1000 / 25;
+			nextFrameTimeStamp += 1000 / 25;
 			_stub->processEvents();
 			if (_stub->_pi.quit || _stub->_pi.backspace) {
 				_stub->_pi.backspace = false;
 				break;
 			}
-			if (!_demux.readFrameData()) {
-				break;
-			}
-			if (_demux._audioDataOffset != 0) {
-				SoundBufferQueue *sbq = (SoundBufferQueue *)malloc(sizeof(SoundBufferQueue));
-				if (sbq) {
-					sbq->data = (int16_t *)calloc(SeqDemuxer::kAudioBufferSize, sizeof(int16_t));
-					if (sbq->data) {
-						_demux.readAudio(sbq->data);
-						sbq->size = SeqDemuxer::kAudioBufferSize;
-						sbq->read = 0;
-						sbq->next = 0;
-					} else {
-						free(sbq);
-						sbq = 0;
-					}
+			const Frame *frame = 0;
+			{
+				std::unique_lock<std::mutex> lock(_framesMutex);
+				while (_framesCount == 0 && !_decodeEnd) {
+					_framesCond.wait(lock);
 				}
-				if (sbq) {
-					LockAudioStack las(_stub);
-					if (_soundQueueTail) {
-						_soundQueueTail->next = sbq;
-					} else {
-						assert(!_soundQueue);
-						_soundQueue = sbq;
-					}
-					_soundQueueTail = sbq;
-					if (_soundQueuePreloadSize < kSoundPreloadSize) {
-						++_soundQueuePreloadSize;
-					}
+				if (_framesCount != 0) {
+					frame = &_frames[_framesHead];
 				}
 			}
-			if (_demux._paletteDataOffset != 0) {
-				uint8_t buf[256 * 3];
-				_demux.readPalette(buf);
-				for (int i = 0; i < 256 * 3; ++i) {
-					buf[i] = (buf[i] << 2) | (buf[i] >> 4);
+			if (!frame) {
+				break;
+			}
+			if (frame->hasAudio) {
+				if (_soundQueue.space() < SeqDemuxer::kAudioBufferSize) {
+					// audio is not being consumed (paused or no output)
+					debug(DBG_SND, "SeqPlayer::play() sound queue full, dropping frame");
+				} else {
+					_soundQueue.write(frame->audio, SeqDemuxer::kAudioBufferSize);
 				}
-				_stub->setPalette(buf, 256);
 			}
-			if (_demux._videoData != -1) {
+			if (frame->hasPalette) {
+				_stub->setPalette(frame->palette, 256);
+			}
+			if (frame->hasVideo) {
 				const int y0 = (224 - kVideoHeight) / 2;
-				const uint8_t *src = _demux._buffers[_demux._videoData].data;
-				_demux.clearBuffer(_demux._videoData);
-				BitStream bs(src); src += 128;
-				for (int y = 0; y < kVideoHeight; y += 8) {
-					for (int x = 0; x < kVideoWidth; x += 8) {
-						const int offset = (y0 + y) * 256 + x;
-						switch (bs.getBits(2)) {
-						case 1:
-							src = decodeSeqOp1(_buf + offset, 256, src);
-							break;
-						case 2:
-							src = decodeSeqOp2(_buf + offset, 256, src);
-							break;
-						case 3:
-							src = decodeSeqOp3(_buf + offset, 256, src);
-							break;
-						}
-					}
-				}
+				memcpy(_buf + y0 * 256, frame->video, kVideoWidth * kVideoHeight);
 				if (clearScreen) {
 					clearScreen = false;
 					_stub->copyRect(0, 0, kVideoWidth, 224, _buf, 256);
@@ -306,51 +337,131 @@ void SeqPlayer::play(File *f) {
 				}
 				_stub->updateScreen(0);
 			}
+			{
+				std::unique_lock<std::mutex> lock(_framesMutex);
+				_framesHead = (_framesHead + 1) % kFrameQueueSize;
+				--_framesCount;
+				_framesCond.notify_all();
+			}
 			const int diff = nextFrameTimeStamp - _stub->getTimeStamp();
 			if (diff > 0) {
 				_stub->sleep(diff);
+			} else if (diff < -1000 / 25) {
+				// more than a frame late, do not try to catch up
+				nextFrameTimeStamp = _stub->getTimeStamp();
 			}
 		}
+		{
+			std::unique_lock<std::mutex> lock(_framesMutex);
+			_decodeStop = true;
+			_framesCond.notify_all();
+		}
+		decodeThread.join();
+		free(_frames);
+		_frames = 0;
+		free(_decodeBuffer);
+		_decodeBuffer = 0;
 		// restore level palette
 		_stub->setPalette(palette, 256);
 		_mix->setPremixHook(0, 0);
 		_demux.close();
-		// flush sound queue
-		LockAudioStack las(_stub);
-		while (_soundQueue) {
-			SoundBufferQueue *next = _soundQueue->next;
-			free(_soundQueue->data);
-			free(_soundQueue);
-			_soundQueue = next;
+		// flush sound queue, the audio callback is no longer reading from it
+		_soundQueue.reset();
+		_soundQueuePreloaded = false;
+	} else {
+		_demux.close();
+	}
+}
+
+void SeqPlayer::decodeFrames() {
+	while (true) {
+		Frame *frame = 0;
+		{
+			std::unique_lock<std::mutex> lock(_framesMutex);
+			while (_framesCount == kFrameQueueSize && !_decodeStop) {
+				_framesCond.wait(lock);
+			}
+			if (_decodeStop) {
+				break;
+			}
+			frame = &_frames[(_framesHead + _framesCount) % kFrameQueueSize];
+		}
+		if (!_demux.readFrameData()) {
+			std::unique_lock<std::mutex> lock(_framesMutex);
+			_decodeEnd = true;
+			_framesCond.notify_all();
+			break;
 		}
-		_soundQueueTail = 0;
-		_soundQueuePreloadSize = 0;
+		frame->hasAudio = (_demux._audioDataOffset != 0);
+		if (frame->hasAudio) {
+			_demux.readAudio(frame->audio);
+		}
+		frame->hasPalette = (_demux._paletteDataOffset != 0);
+		if (frame->hasPalette) {
+			_demux.readPalette(frame->palette);
+			for (int i = 0; i < 256 * 3; ++i) {
+				frame->palette[i] = (frame->palette[i] << 2) | (frame->palette[i] >> 4);
+			}
+		}
+		frame->hasVideo = (_demux._videoData != -1);
+		if (frame->hasVideo) {
+			const uint8_t *src = _demux._buffers[_demux._videoData].data;
+			_demux.clearBuffer(_demux._videoData);
+			BitStream bs(src); src += 128;
+			for (int y = 0; y < kVideoHeight; y += 8) {
+				for (int x = 0; x < kVideoWidth; x += 8) {
+					const int offset = y * kVideoWidth + x;
+					switch (bs.getBits(2)) {
+					case 1:
+						src = decodeSeqOp1(_decodeBuffer + offset, kVideoWidth, src);
+						break;
+					case 2:
+						src = decodeSeqOp2(_decodeBuffer + offset, kVideoWidth, src);
+						break;
+					case 3:
+						src = decodeSeqOp3(_decodeBuffer + offset, kVideoWidth, src);
+						break;
+					}
+				}
+			}
+			memcpy(frame->video, _decodeBuffer, kVideoWidth * kVideoHeight);
+		}
+		std::unique_lock<std::mutex> lock(_framesMutex);
+		++_framesCount;
+		_framesCond.notify_all();
 	}
 }
 
+void SeqPlayer::decodeThreadProc(SeqPlayer *player) {
+	player->decodeFrames();
+}
+
 bool SeqPlayer::mix(int16_t *buf, int samples) {
-	if (_soundQueuePreloadSize < kSoundPreloadSize) {
-		return true;
-	}
-	while (_soundQueue && samples > 0) {
-		const int count = MIN(samples, _soundQueue->size - _soundQueue->read);
-		const int16_t *src = (const int16_t *)(_soundQueue->data + _soundQueue->read);
-		for (int i = 0; i < count; ++i) {
-			const int16_t sample = *src++;
-			*buf++ = sample;
-			*buf++ = sample;
+	if (!_soundQueuePreloaded) {
+		if (_soundQueue.available() < kSoundPreloadSize * SeqDemuxer::kAudioBufferSize) {
+			return true;
 		}
-		_soundQueue->read += count;
-		if (_soundQueue->read == _soundQueue->size) {
-			SoundBufferQueue *next = _soundQueue->next;
-			free(_soundQueue->data);
-			free(_soundQueue);
-			_soundQueue = next;
-		}
-		samples -= count;
+		_soundQueuePreloaded = true;
+		_soundBufferPos = _soundBufferLen = 0;
+		_soundFrac = 0;
 	}
-	if (!_soundQueue) {
-		_soundQueueTail = 0;
+	const uint32_t inc = (kSoundSampleRate << 16) / _mix->getSampleRate();
+	while (samples > 0) {
+		while (_soundBufferPos >= _soundBufferLen) {
+			_soundBufferPos -= _soundBufferLen;
+			_soundBufferLen = _soundQueue.read(_soundBuffer, ARRAYSIZE(_soundBuffer));
+			if (_soundBufferLen == 0) {
+				_soundBufferPos = 0;
+				return true;
+			}
+		}
+		const int16_t sample = _soundBuffer[_soundBufferPos];
+		*buf++ = sample;
+		*buf++ = sample;
+		--samples;
+		_soundFrac += inc;
+		_soundBufferPos += _soundFrac >> 16;
+		_soundFrac &= 0xFFFF;
 	}
 	return true;
 }
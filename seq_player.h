@@ -7,7 +7,10 @@
 #ifndef SEQ_PLAYER_H__
 #define SEQ_PLAYER_H__
 
+#include <condition_variable>
+#include <mutex>
 #include "intern.h"
+#include "ring_buffer.h"
 
 struct File;
 struct SystemStub;
@@ -17,13 +20,15 @@ struct SeqDemuxer {
 	enum {
 		kFrameSize = 6144,
 		kAudioBufferSize = 882,
-		kBuffersCount = 30
+		kBuffersCount = 30,
+		kReadAheadFrames = 16
 	};
 
 	bool open(File *f);
 	void close();
 
 	bool readHeader();
+	bool loadFrame(int offset);
 	bool readFrameData();
 	void fillBuffer(int num, int offset, int size);
 	void clearBuffer(int num);
@@ -41,22 +46,30 @@ struct SeqDemuxer {
 	} _buffers[kBuffersCount];
 	int _fileSize;
 	File *_f;
+	uint8_t *_readAheadBuffer;
+	int _readAheadOffset;
+	int _readAheadSize;
+	const uint8_t *_frameData;
 };
 
 struct SeqPlayer {
 	enum {
 		kVideoWidth = 256,
 		kVideoHeight = 128,
-		kSoundPreloadSize = 4
+		kSoundPreloadSize = 4,
+		kFrameQueueSize = 4,
+		kSoundSampleRate = 22050
 	};
 
 	static const char *const _namesTable[];
 
-	struct SoundBufferQueue {
-		int16_t *data;
-		int size;
-		int read;
-		SoundBufferQueue *next;
+	struct Frame {
+		bool hasVideo;
+		bool hasPalette;
+		bool hasAudio;
+		uint8_t video[kVideoWidth * kVideoHeight];
+		uint8_t palette[256 * 3];
+		int16_t audio[SeqDemuxer::kAudioBufferSize];
 	};
 
 	SeqPlayer(SystemStub *stub, Mixer *mixer);
@@ -64,6 +77,8 @@ struct SeqPlayer {
 
 	void setBackBuffer(uint8_t *buf) { _buf = buf; }
 	void play(File *f);
+	void decodeFrames();
+	static void decodeThreadProc(SeqPlayer *player);
 	bool mix(int16_t *buf, int len);
 	static bool mixCallback(void *param, int16_t *buf, int len);
 
@@ -71,8 +86,19 @@ struct SeqPlayer {
 	uint8_t *_buf;
 	Mixer *_mix;
 	SeqDemuxer _demux;
-	int _soundQueuePreloadSize;
-	SoundBufferQueue *_soundQueue, *_soundQueueTail;
+	RingBuffer<int16_t> _soundQueue; // written by play(), read by the audio callback
+	bool _soundQueuePreloaded;
+	// resampling state for the mixer output rate, only used by the audio callback
+	int16_t _soundBuffer[256];
+	int _soundBufferPos, _soundBufferLen;
+	uint32_t _soundFrac;
+	// frames decoded ahead by the decoding thread
+	Frame *_frames;
+	int _framesHead, _framesCount;
+	bool _decodeStop, _decodeEnd;
+	std::mutex _framesMutex;
+	std::condition_variable _framesCond;
+	uint8_t *_decodeBuffer;
 };
 
 #endif // SEQ_PLAYER_H__
@@ -75,6 +75,9 @@ void SfxPlayer::playSample(int channel, const uint8_t *sampleData, uint16_t peri
 	si->freq = PAULA_FREQ / period;
 	si->pos = 0;
 	si->data = sampleData;
+	for (int i = 0; i < 256; ++i) {
+		si->volumeTable[i] = S8_to_S16(i) * si->vol / kMasterVolume;
+	}
 }
 
 void SfxPlayer::handleTick() {
@@ -122,45 +125,61 @@ void SfxPlayer::handleTick() {
 	}
 }
 
+// the runs end before the sample (or loop) end, the PCM data is fetched without clamping
+void SfxPlayer::mixChannel(SampleInfo *si, int32_t *acc, int samplesLen) {
+	const int len = si->len << FRAC_BITS;
+	const int loopLen = si->loopLen << FRAC_BITS;
+	const int loopPos = si->loopPos << FRAC_BITS;
+	const int deltaPos = (si->freq << FRAC_BITS) / _mix->getSampleRate();
+	if (loopLen > (2 << FRAC_BITS)) {
+		assert(si->loopPos + si->loopLen <= si->len);
+	}
+	const uint8_t *data = si->data;
+	int pos = si->pos;
+	while (samplesLen != 0) {
+		int count;
+		if (loopLen > (2 << FRAC_BITS)) {
+			if (pos >= loopPos + loopLen) {
+				pos -= loopLen;
+			}
+			count = MIN(samplesLen, (loopPos + loopLen - pos - 1) / deltaPos + 1);
+			samplesLen -= count;
+		} else {
+			if (pos >= len) {
+				count = 0;
+			} else {
+				count = MIN(samplesLen, (len - pos - 1) / deltaPos + 1);
+			}
+			samplesLen = 0;
+		}
+		for (int i = 0; i < count; ++i) {
+			acc[i] += si->volumeTable[data[pos >> FRAC_BITS]];
+			pos += deltaPos;
+		}
+		acc += count;
+	}
+	si->pos = pos;
+}
+
 void SfxPlayer::mixSamples(int16_t *buf, int samplesLen) {
-	for (int i = 0; i < NUM_CHANNELS; ++i) {
-		SampleInfo *si = &_samples[i];
-		if (si->data) {
-			int16_t *mixbuf = buf;
-			int len = si->len << FRAC_BITS;
-			int loopLen = si->loopLen << FRAC_BITS;
-			int loopPos = si->loopPos << FRAC_BITS;
-			int deltaPos = (si->freq << FRAC_BITS) / _mix->getSampleRate();
-			int curLen = samplesLen;
-			int pos = si->pos;
-			while (curLen != 0) {
-				int count;
-				if (loopLen > (2 << FRAC_BITS)) {
-					assert(si->loopPos + si->loopLen <= si->len);
-					if (pos >= loopPos + loopLen) {
-						pos -= loopLen;
-					}
-					count = MIN(curLen, (loopPos + loopLen - pos - 1) / deltaPos + 1);
-					curLen -= count;
-				} else {
-					if (pos >= len) {
-						count = 0;
-					} else {
-						count = MIN(curLen, (len - pos - 1) / deltaPos + 1);
-					}
-					curLen = 0;
-				}
-				while (count--) {
-					const int sample = S8_to_S16(si->getPCM(pos >> FRAC_BITS)) * si->vol / kMasterVolume;
-					*mixbuf = ADDC_S16(*mixbuf, sample);
-					++mixbuf;
-					*mixbuf = ADDC_S16(*mixbuf, sample);
-					++mixbuf;
-					pos += deltaPos;
+	while (samplesLen != 0) {
+		const int count = MIN(samplesLen, (int)MIX_BLOCK_SIZE);
+		bool mixed = false;
+		for (int i = 0; i < NUM_CHANNELS; ++i) {
+			SampleInfo *si = &_samples[i];
+			if (si->data) {
+				if (!mixed) {
+					memset(_mixBuf, 0, sizeof(int32_t) * count);
+					mixed = true;
 				}
+				mixChannel(si, _mixBuf, count);
 			}
-			si->pos = pos;
 		}
+		if (mixed) {
+			Mixer::packSamples(buf, _mixBuf, count);
+		}
+		buf += count * 2; // stereo
+		samplesLen -= count;
 	}
 }
 
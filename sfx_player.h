@@ -16,7 +16,8 @@ struct SfxPlayer {
 		NUM_SAMPLES = 5,
 		NUM_CHANNELS = 3,
 		FRAC_BITS = 12,
-		PAULA_FREQ = 3546897
+		PAULA_FREQ = 3546897,
+		MIX_BLOCK_SIZE = 512
 	};
 
 	struct Module {
@@ -32,15 +33,7 @@ struct SfxPlayer {
 		int freq;
 		int pos;
 		const uint8_t *data;
-
-		int8_t getPCM(int offset) const {
-			if (offset < 0) {
-				offset = 0;
-			} else if (offset >= (int)len) {
-				offset = len - 1;
-			}
-			return (int8_t)data[offset];
-		}
+		int32_t volumeTable[256]; // PCM scaled by the sample and master volumes
 	};
 
 	static const uint8_t _musicData68[];
@@ -74,6 +67,7 @@ struct SfxPlayer {
 	const uint8_t *_modData;
 	SampleInfo _samples[NUM_CHANNELS];
 	Mixer *_mix;
+	int32_t _mixBuf[MIX_BLOCK_SIZE];
 
 	SfxPlayer(Mixer *mixer);
 
@@ -81,6 +75,7 @@ struct SfxPlayer {
 	void stop();
 	void playSample(int channel, const uint8_t *sampleData, uint16_t period);
 	void handleTick();
+	void mixChannel(SampleInfo *si, int32_t *acc, int samplesLen);
 	void mixSamples(int16_t *samples, int samplesLen);
 
 	bool mix(int16_t *buf, int len);
@@ -8,6 +8,7 @@
 #define SYSTEMSTUB_H__
 
 #include "intern.h"
+#include "audio_stats.h"
 #include "scaler.h"
 
 struct PlayerInput {
@@ -50,14 +51,21 @@ struct ScalerParameters {
 	static ScalerParameters defaults();
 };
 
+struct AudioParameters {
+	int sampleRate;
+	int bufferSize; // in samples
+	static AudioParameters defaults();
+};
+
 struct SystemStub {
 	typedef void (*AudioCallback)(void *param, int16_t *stream, int len);
 
 	PlayerInput _pi;
+	AudioStats _audioStats;
 
 	virtual ~SystemStub() {}
 
-	virtual void init(const char *title, int w, int h, bool fullscreen, int widescreenMode, bool maximized, const ScalerParameters *scalerParameters) = 0;
+	virtual void init(const char *title, int w, int h, bool fullscreen, int widescreenMode, bool maximized, const ScalerParameters *scalerParameters, const AudioParameters *audioParameters) = 0;
 	virtual void destroy() = 0;
 
 	virtual bool hasWidescreen() const = 0;
@@ -87,6 +95,7 @@ struct SystemStub {
 	virtual void startAudio(AudioCallback callback, void *param) = 0;
 	virtual void stopAudio() = 0;
 	virtual uint32_t getOutputSampleRate() = 0;
+	virtual uint32_t getOutputBufferSize() = 0;
 	virtual void lockAudio() = 0;
 	virtual void unlockAudio() = 0;
 };
@@ -11,6 +11,8 @@
 #include "util.h"
 
 static const int kAudioHz = 22050;
+static const int kAudioBufferSize = 4096;
+static const uint32_t kAudioStatsTraceInterval = 10 * 1000; // ms
 
 static const char *kIconBmp = "icon.bmp";
 
@@ -19,6 +21,9 @@ static const int kJoystickCommitValue = 3200;
 
 static const uint32_t kPixelFormat = SDL_PIXELFORMAT_RGB888;
 
+// extra source pixels scaled around a partial update, covers the scalers neighbourhood
+static const int kScalerMargin = 4;
+
 ScalerParameters ScalerParameters::defaults() {
 	ScalerParameters params;
 	params.type = kScalerTypeInternal;
@@ -27,6 +32,13 @@ ScalerParameters ScalerParameters::defaults() {
 	return params;
 }
 
+AudioParameters AudioParameters::defaults() {
+	AudioParameters params;
+	params.sampleRate = kAudioHz;
+	params.bufferSize = kAudioBufferSize;
+	return params;
+}
+
 struct SystemStub_SDL : SystemStub {
 	SDL_Window *_window;
 	SDL_Renderer *_renderer;
@@ -37,6 +49,8 @@ struct SystemStub_SDL : SystemStub {
 	SDL_PixelFormat *_fmt;
 	const char *_caption;
 	uint32_t *_screenBuffer;
+	SDL_Rect _dirtyRect;
+	uint32_t *_scalerBuffer;
 	bool _fullscreen;
 	bool _maximizeWindow;
 	uint32_t _clearColor;
@@ -47,6 +61,12 @@ struct SystemStub_SDL : SystemStub {
 	bool _fadeOnUpdateScreen;
 	void (*_audioCbProc)(void *, int16_t *, int);
 	void *_audioCbData;
+	SDL_AudioDeviceID _audioDevice;
+	AudioParameters _audioParameters;
+	int _audioSampleRate;
+	int _audioBufferSize;
+	uint64_t _audioCbTimeStamp;
+	uint32_t _audioStatsTimeStamp;
 	ScalerType _scalerType;
 	int _scaleFactor;
 	const Scaler *_scaler;
@@ -57,7 +77,7 @@ struct SystemStub_SDL : SystemStub {
 	bool _enableWidescreen;
 
 	virtual ~SystemStub_SDL() {}
-	virtual void init(const char *title, int w, int h, bool fullscreen, int widescreenMode, bool maximized, const ScalerParameters *scalerParameters);
+	virtual void init(const char *title, int w, int h, bool fullscreen, int widescreenMode, bool maximized, const ScalerParameters *scalerParameters, const AudioParameters *audioParameters);
 	virtual void destroy();
 	virtual bool hasWidescreen() const;
 	virtual void setScreenSize(int w, int h);
@@ -84,6 +104,7 @@ struct SystemStub_SDL : SystemStub {
 	virtual void startAudio(AudioCallback callback, void *param);
 	virtual void stopAudio();
 	virtual uint32_t getOutputSampleRate();
+	virtual uint32_t getOutputBufferSize();
 	virtual void lockAudio();
 	virtual void unlockAudio();
 
@@ -95,13 +116,14 @@ struct SystemStub_SDL : SystemStub {
 	void setScaler(const ScalerParameters *parameters);
 	void changeScaler(int scalerNum);
 	void drawRect(int x, int y, int w, int h, uint8_t color);
+	void addDirtyRect(int x, int y, int w, int h);
 };
 
 SystemStub *SystemStub_SDL_create() {
 	return new SystemStub_SDL();
 }
 
-void SystemStub_SDL::init(const char *title, int w, int h, bool fullscreen, int widescreenMode, bool maximized, const ScalerParameters *scalerParameters) {
+void SystemStub_SDL::init(const char *title, int w, int h, bool fullscreen, int widescreenMode, bool maximized, const ScalerParameters *scalerParameters, const AudioParameters *audioParameters) {
 	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER);
 	SDL_ShowCursor(SDL_DISABLE);
 	_caption = title;
@@ -111,6 +133,8 @@ void SystemStub_SDL::init(const char *title, int w, int h, bool fullscreen, int
 	_texture = 0;
 	_fmt = SDL_AllocFormat(kPixelFormat);
 	_screenBuffer = 0;
+	_dirtyRect.x = _dirtyRect.y = _dirtyRect.w = _dirtyRect.h = 0;
+	_scalerBuffer = 0;
 	_fadeOnUpdateScreen = false;
 	_fullscreen = fullscreen;
 	_maximizeWindow = maximized;
@@ -119,6 +143,10 @@ void SystemStub_SDL::init(const char *title, int w, int h, bool fullscreen, int
 	_scaleFactor = 1;
 	_scaler = 0;
 	_scalerSo = 0;
+	_audioDevice = 0;
+	_audioParameters = *audioParameters;
+	_audioSampleRate = _audioParameters.sampleRate;
+	_audioBufferSize = _audioParameters.bufferSize;
 	if (scalerParameters->name[0]) {
 		setScaler(scalerParameters);
 	}
@@ -244,6 +272,8 @@ void SystemStub_SDL::copyRect(int x, int y, int w, int h, const uint8_t *buf, in
 		h = _screenH - y;
 	}
 
+	addDirtyRect(x, y, w, h);
+
 	uint32_t *p = _screenBuffer + y * _screenW + x;
 	buf += y * pitch + x;
 
@@ -262,6 +292,7 @@ void SystemStub_SDL::copyRect(int x, int y, int w, int h, const uint8_t *buf, in
 
 void SystemStub_SDL::copyRectRgb24(int x, int y, int w, int h, const uint8_t *rgb) {
 	assert(x >= 0 && x + w <= _screenW && y >= 0 && y + h <= _screenH);
+	addDirtyRect(x, y, w, h);
 	uint32_t *p = _screenBuffer + y * _screenW + x;
 
 	for (int j = 0; j < h; ++j) {
@@ -517,17 +548,38 @@ void SystemStub_SDL::fadeScreen() {
 }
 
 void SystemStub_SDL::updateScreen(int shakeOffset) {
-	if (_texW != _screenW || _texH != _screenH) {
-		void *dst = 0;
-		int pitch = 0;
-		if (SDL_LockTexture(_texture, 0, &dst, &pitch) == 0) {
-			assert((pitch & 3) == 0);
-			_scaler->scale(_scaleFactor, (uint32_t *)dst, pitch / sizeof(uint32_t), _screenBuffer, _screenW, _screenW, _screenH);
-			SDL_UnlockTexture(_texture);
+	if (SDL_RectEmpty(&_dirtyRect)) {
+		// texture is up to date
+	} else if (_texW != _screenW || _texH != _screenH) {
+		if (_dirtyRect.w == _screenW && _dirtyRect.h == _screenH) {
+			void *dst = 0;
+			int pitch = 0;
+			if (SDL_LockTexture(_texture, 0, &dst, &pitch) == 0) {
+				assert((pitch & 3) == 0);
+				_scaler->scale(_scaleFactor, (uint32_t *)dst, pitch / sizeof(uint32_t), _screenBuffer, _screenW, _screenW, _screenH);
+				SDL_UnlockTexture(_texture);
+			}
+		} else {
+			SDL_Rect r;
+			r.x = MAX(_dirtyRect.x - kScalerMargin, 0);
+			r.y = MAX(_dirtyRect.y - kScalerMargin, 0);
+			r.w = MIN(_dirtyRect.x + _dirtyRect.w + kScalerMargin, _screenW) - r.x;
+			r.h = MIN(_dirtyRect.y + _dirtyRect.h + kScalerMargin, _screenH) - r.y;
+			const int factor = _scaleFactor;
+			const int pitch = r.w * factor;
+			_scaler->scale(factor, _scalerBuffer, pitch, _screenBuffer + r.y * _screenW + r.x, _screenW, r.w, r.h);
+			SDL_Rect texRect;
+			texRect.x = _dirtyRect.x * factor;
+			texRect.y = _dirtyRect.y * factor;
+			texRect.w = _dirtyRect.w * factor;
+			texRect.h = _dirtyRect.h * factor;
+			const uint32_t *src = _scalerBuffer + (_dirtyRect.y - r.y) * factor * pitch + (_dirtyRect.x - r.x) * factor;
+			SDL_UpdateTexture(_texture, &texRect, src, pitch * sizeof(uint32_t));
 		}
 	} else {
-		SDL_UpdateTexture(_texture, 0, _screenBuffer, _screenW * sizeof(uint32_t));
+		SDL_UpdateTexture(_texture, &_dirtyRect, _screenBuffer + _dirtyRect.y * _screenW + _dirtyRect.x, _screenW * sizeof(uint32_t));
 	}
+	_dirtyRect.w = _dirtyRect.h = 0;
 	SDL_RenderClear(_renderer);
 	if (_widescreenMode != kWidescreenNone) {
 		if (_enableWidescreen) {
@@ -573,6 +625,13 @@ void SystemStub_SDL::updateScreen(int shakeOffset) {
 }
 
 void SystemStub_SDL::processEvents() {
+	if ((g_debugMask & DBG_SND) != 0 && _audioDevice != 0) {
+		const uint32_t timeStamp = SDL_GetTicks();
+		if (timeStamp - _audioStatsTimeStamp >= kAudioStatsTraceInterval) {
+			_audioStats.dump(true);
+			_audioStatsTimeStamp = timeStamp;
+		}
+	}
 	bool paused = false;
 	while (true) {
 		SDL_Event ev;
@@ -616,10 +675,22 @@ void SystemStub_SDL::processEvent(const SDL_Event &ev, bool &paused) {
 		case SDL_WINDOWEVENT_FOCUS_GAINED:
 		case SDL_WINDOWEVENT_FOCUS_LOST:
 			paused = (ev.window.event == SDL_WINDOWEVENT_FOCUS_LOST);
-			SDL_PauseAudio(paused);
+			if (_audioDevice != 0) {
+				if (!paused) {
+					// do not count the pause as an underrun
+					LockAudioStack las(this);
+					_audioCbTimeStamp = 0;
+				}
+				SDL_PauseAudioDevice(_audioDevice, paused);
+			}
 			break;
 		}
 		break;
+	case SDL_RENDER_TARGETS_RESET:
+	case SDL_RENDER_DEVICE_RESET:
+		// texture content may have been lost
+		addDirtyRect(0, 0, _screenW, _screenH);
+		break;
 	case SDL_JOYHATMOTION:
 		if (_joystick) {
 			_pi.dirMask = 0;
@@ -794,6 +865,9 @@ void SystemStub_SDL::processEvent(const SDL_Event &ev, bool &paused) {
 			case SDLK_x:
 				_pi.quit = true;
 				break;
+			case SDLK_a:
+				_audioStats.dump(false);
+				break;
 			}
 			break;
 		} else if (ev.key.keysym.mod & KMOD_CTRL) {
@@ -933,43 +1007,80 @@ uint32_t SystemStub_SDL::getTimeStamp() {
 
 static void mixAudioS16(void *param, uint8_t *buf, int len) {
 	SystemStub_SDL *stub = (SystemStub_SDL *)param;
+	// the previous callback was too late if more than one and a half buffer was consumed since
+	const uint64_t timeStamp = SDL_GetPerformanceCounter();
+	if (stub->_audioCbTimeStamp != 0) {
+		const uint64_t duration = SDL_GetPerformanceFrequency() * stub->_audioBufferSize / stub->_audioSampleRate;
+		if (timeStamp - stub->_audioCbTimeStamp > duration + duration / 2) {
+			stub->_audioStats.addUnderrun();
+			debug(DBG_SND, "Audio underrun, %d ms since last callback", (int)((timeStamp - stub->_audioCbTimeStamp) * 1000 / SDL_GetPerformanceFrequency()));
+		}
+	}
+	stub->_audioCbTimeStamp = timeStamp;
 	memset(buf, 0, len);
 	assert((len & 3) == 0);
 	stub->_audioCbProc(stub->_audioCbData, (int16_t *)buf, len / (sizeof(int16_t) * 2));
+	stub->_audioStats.addCallback((uint32_t)((SDL_GetPerformanceCounter() - timeStamp) * 1000000 / SDL_GetPerformanceFrequency()));
 }
 
 void SystemStub_SDL::startAudio(AudioCallback callback, void *param) {
-	SDL_AudioSpec desired;
+	SDL_AudioSpec desired, obtained;
 	memset(&desired, 0, sizeof(desired));
-	desired.freq = kAudioHz;
+	desired.freq = _audioParameters.sampleRate;
 	desired.format = AUDIO_S16SYS;
 	desired.channels = 2;
-	desired.samples = 4096;
+	desired.samples = _audioParameters.bufferSize;
 	desired.callback = mixAudioS16;
 	desired.userdata = this;
-	if (SDL_OpenAudio(&desired, 0) == 0) {
-		_audioCbProc = callback;
-		_audioCbData = param;
-		SDL_PauseAudio(0);
+	_audioCbProc = callback;
+	_audioCbData = param;
+	_audioCbTimeStamp = 0;
+	// the mixer output is always signed 16 bits stereo, let SDL convert the samples if the device needs a different format
+	_audioDevice = SDL_OpenAudioDevice(0, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+	if (_audioDevice != 0) {
+		_audioSampleRate = obtained.freq;
+		_audioBufferSize = obtained.samples;
+		_audioStats.reset(_audioBufferSize, _audioSampleRate);
+		_audioStatsTimeStamp = SDL_GetTicks();
+		info("Audio device opened, rate %d Hz, buffer %d samples (%d ms)", _audioSampleRate, _audioBufferSize, _audioBufferSize * 1000 / _audioSampleRate);
+		SDL_PauseAudioDevice(_audioDevice, 0);
 	} else {
-		error("SystemStub_SDL::startAudio() Unable to open sound device");
+		error("SystemStub_SDL::startAudio() Unable to open sound device, %s", SDL_GetError());
 	}
 }
 
 void SystemStub_SDL::stopAudio() {
-	SDL_CloseAudio();
+	if (_audioDevice != 0) {
+		SDL_CloseAudioDevice(_audioDevice);
+		_audioDevice = 0;
+		_audioStats.dump(true);
+		const uint32_t underruns = _audioStats._underruns.load(std::memory_order_relaxed);
+		if (underruns != 0) {
+			warning("%d audio underruns with a buffer of %d samples", underruns, _audioBufferSize);
+		}
+	}
 }
 
 uint32_t SystemStub_SDL::getOutputSampleRate() {
-	return kAudioHz;
+	return _audioSampleRate;
+}
+
+uint32_t SystemStub_SDL::getOutputBufferSize() {
+	return _audioBufferSize;
 }
 
 void SystemStub_SDL::lockAudio() {
-	SDL_LockAudio();
+	if (_audioDevice != 0) {
+		const uint64_t timeStamp = AudioStats::getTimeUs();
+		SDL_LockAudioDevice(_audioDevice);
+		_audioStats._lockWait.add((uint32_t)(AudioStats::getTimeUs() - timeStamp));
+	}
 }
 
 void SystemStub_SDL::unlockAudio() {
-	SDL_UnlockAudio();
+	if (_audioDevice != 0) {
+		SDL_UnlockAudioDevice(_audioDevice);
+	}
 }
 
 static bool is16_9(const SDL_DisplayMode *mode) {
@@ -1027,6 +1138,13 @@ void SystemStub_SDL::prepareGraphics() {
 	_renderer = SDL_CreateRenderer(_window, -1, SDL_RENDERER_ACCELERATED);
 	SDL_RenderSetLogicalSize(_renderer, windowW, windowH);
 	_texture = SDL_CreateTexture(_renderer, kPixelFormat, SDL_TEXTUREACCESS_STREAMING, _texW, _texH);
+	if (_texW != _screenW || _texH != _screenH) {
+		_scalerBuffer = (uint32_t *)malloc(_texW * _texH * sizeof(uint32_t));
+		if (!_scalerBuffer) {
+			error("SystemStub_SDL::prepareGraphics() Unable to allocate scaler buffer, w=%d, h=%d", _texW, _texH);
+		}
+	}
+	addDirtyRect(0, 0, _screenW, _screenH);
 	if (_widescreenMode != kWidescreenNone) {
 		int w = _screenH * 16 / 9;
 		// in blur mode, the background texture has the same dimensions as the game texture
@@ -1049,6 +1167,8 @@ void SystemStub_SDL::prepareGraphics() {
 }
 
 void SystemStub_SDL::cleanupGraphics() {
+	free(_scalerBuffer);
+	_scalerBuffer = 0;
 	if (_texture) {
 		SDL_DestroyTexture(_texture);
 		_texture = 0;
@@ -1193,3 +1313,16 @@ void SystemStub_SDL::drawRect(int x, int y, int w, int h, uint8_t color) {
 		*(_screenBuffer + j * _screenW + x1) = *(_screenBuffer + j * _screenW + x2) = _rgbPalette[color];
 	}
 }
+
+void SystemStub_SDL::addDirtyRect(int x, int y, int w, int h) {
+	SDL_Rect r;
+	r.x = x;
+	r.y = y;
+	r.w = w;
+	r.h = h;
+	if (SDL_RectEmpty(&_dirtyRect)) {
+		_dirtyRect = r;
+	} else {
+		SDL_UnionRect(&_dirtyRect, &r, &_dirtyRect);
+	}
+}
@@ -58,7 +58,7 @@ static void copyReference(BytekillerCtx *uc, int len, int offset) { // copyd3byt
 	}
 }
 
-bool bytekiller_unpack(uint8_t *dst, int dstSize, const uint8_t *src, int srcSize) {
+bool bytekiller_unpack_reference(uint8_t *dst, int dstSize, const uint8_t *src, int srcSize) {
 	BytekillerCtx uc;
 	uc.src = src + srcSize - 4;
 	uc.size = READ_BE_UINT32(uc.src); uc.src -= 4;
@@ -101,6 +101,116 @@ bool bytekiller_unpack(uint8_t *dst, int dstSize, const uint8_t *src, int srcSiz
 	return uc.crc == 0;
 }
 
+// The stream is a sequence of 32 bits words read backwards, each one consumed
+// from its least significant bit. The words are bit reversed when loaded so
+// that the next bits to decode are the most significant ones of a 64 bits
+// buffer. A word is only loaded when the bits are needed, like nextBit(),
+// as the CRC covers the words read and the last one is the start of the data.
+
+struct BytekillerReader {
+	uint64_t bits;
+	int count;
+	uint32_t crc;
+	const uint8_t *src;
+};
+
+static uint32_t reverseBits32(uint32_t v) {
+	v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+	v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+	v = ((v >> 4) & 0x0F0F0F0F) | ((v & 0x0F0F0F0F) << 4);
+	v = ((v >> 8) & 0x00FF00FF) | ((v & 0x00FF00FF) << 8);
+	return (v >> 16) | (v << 16);
+}
+
+static inline uint32_t peekBits(BytekillerReader *r, int count) {
+	if (r->count < count) {
+		const uint32_t bits = READ_BE_UINT32(r->src); r->src -= 4;
+		r->crc ^= bits;
+		r->bits |= ((uint64_t)reverseBits32(bits)) << (32 - r->count);
+		r->count += 32;
+	}
+	return (uint32_t)(r->bits >> (64 - count));
+}
+
+static inline void skipBits(BytekillerReader *r, int count) {
+	r->bits <<= count;
+	r->count -= count;
+}
+
+static inline uint32_t readBits(BytekillerReader *r, int count) {
+	const uint32_t value = peekBits(r, count);
+	skipBits(r, count);
+	return value;
+}
+
+// indexed by the next 3 bits of the stream
+static const struct {
+	uint8_t codeBits;
+	uint8_t lengthBits;
+	uint8_t lengthBase; // copied length when lengthBits is 0
+	uint8_t offsetBits; // 0 for literals
+} _bytekillerCodes[8] = {
+	{ 2, 3, 1, 0 }, // 00 : 1-8 literals
+	{ 2, 3, 1, 0 },
+	{ 2, 0, 2, 8 }, // 01 : 2 bytes, 8 bits offset
+	{ 2, 0, 2, 8 },
+	{ 3, 0, 3, 9 }, // 100 : 3 bytes, 9 bits offset
+	{ 3, 0, 4, 10 }, // 101 : 4 bytes, 10 bits offset
+	{ 3, 8, 1, 12 }, // 110 : 1-256 bytes, 12 bits offset
+	{ 3, 8, 9, 0 } // 111 : 9-264 literals
+};
+
+bool bytekiller_unpack(uint8_t *dst, int dstSize, const uint8_t *src, int srcSize) {
+	src += srcSize - 4;
+	int size = READ_BE_UINT32(src); src -= 4;
+	if (size > dstSize) {
+		warning("Unexpected unpack size %d, buffer size %d", size, dstSize);
+		return false;
+	}
+	dst += size - 1;
+	BytekillerReader r;
+	r.crc = READ_BE_UINT32(src); src -= 4;
+	const uint32_t bits = READ_BE_UINT32(src); src -= 4;
+	r.crc ^= bits;
+	r.src = src;
+	// the highest bit set marks the end of the first word
+	r.count = 0;
+	while (r.count < 31 && (bits >> (r.count + 1)) != 0) {
+		++r.count;
+	}
+	r.bits = ((uint64_t)reverseBits32(bits & ((1U << r.count) - 1))) << 32;
+	do {
+		// every code is followed by at least 3 bits, peeking does not read past the stream
+		const int code = peekBits(&r, 3);
+		skipBits(&r, _bytekillerCodes[code].codeBits);
+		int len = _bytekillerCodes[code].lengthBase;
+		if (_bytekillerCodes[code].lengthBits != 0) {
+			len += readBits(&r, _bytekillerCodes[code].lengthBits);
+		}
+		size -= len;
+		if (size < 0) {
+			len += size;
+			size = 0;
+		}
+		if (_bytekillerCodes[code].offsetBits == 0) {
+			for (int i = 0; i < len; ++i, --dst) {
+				*dst = (uint8_t)readBits(&r, 8);
+			}
+		} else {
+			const int offset = readBits(&r, _bytekillerCodes[code].offsetBits);
+			if (offset >= len) {
+				dst -= len;
+				memcpy(dst + 1, dst + 1 + offset, len);
+			} else {
+				for (int i = 0; i < len; ++i, --dst) {
+					*dst = *(dst + offset);
+				}
+			}
+		}
+	} while (size > 0);
+	return r.crc == 0;
+}
+
 struct bitstream_t {
 	uint16_t mask;
 	int size;
@@ -10,6 +10,8 @@
 #include "intern.h"
 
 extern bool bytekiller_unpack(uint8_t *dst, int dstSize, const uint8_t *src, int srcSize);
+// bit by bit decoder, kept to check and benchmark bytekiller_unpack
+extern bool bytekiller_unpack_reference(uint8_t *dst, int dstSize, const uint8_t *src, int srcSize);
 extern bool pc98_unpack(uint8_t *dst, int dstSize, const uint8_t *src, int srcSize);
 
 #endif // UNPACK_H__
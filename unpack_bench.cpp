@@ -0,0 +1,183 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <chrono>
+#include "file.h"
+#include "fs.h"
+#include "game.h"
+#include "resource.h"
+#include "unpack.h"
+#include "unpack_bench.h"
+#include "util.h"
+
+static const int kRepeatCount = 4;
+
+struct UnpackBenchStats {
+	const char *name;
+	int entries;
+	int errors;
+	uint64_t size;
+	uint64_t referenceUs, fastUs;
+};
+
+static uint64_t getTimeUs() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 'src' and 'srcSize' as passed to bytekiller_unpack, the unpacked size is stored in the last 4 bytes
+static void benchEntry(UnpackBenchStats *stats, const char *name, const uint8_t *src, int srcSize) {
+	const int size = READ_BE_UINT32(src + srcSize - 4);
+	uint8_t *ref = (uint8_t *)malloc(size);
+	uint8_t *dst = (uint8_t *)malloc(size);
+	if (!ref || !dst) {
+		error("Unable to allocate %d bytes to unpack '%s'", size, name);
+	}
+	bool refRet = false;
+	uint64_t timeStamp = getTimeUs();
+	for (int i = 0; i < kRepeatCount; ++i) {
+		refRet = bytekiller_unpack_reference(ref, size, src, srcSize);
+	}
+	stats->referenceUs += getTimeUs() - timeStamp;
+	bool ret = false;
+	timeStamp = getTimeUs();
+	for (int i = 0; i < kRepeatCount; ++i) {
+		ret = bytekiller_unpack(dst, size, src, srcSize);
+	}
+	stats->fastUs += getTimeUs() - timeStamp;
+	if (!refRet) {
+		warning("Bad CRC for '%s'", name);
+	}
+	if (ret != refRet || memcmp(ref, dst, size) != 0) {
+		warning("Unpacked data differs for '%s'", name);
+		++stats->errors;
+	}
+	++stats->entries;
+	stats->size += size;
+	free(ref);
+	free(dst);
+}
+
+static void dumpStats(const UnpackBenchStats *stats) {
+	if (stats->entries == 0) {
+		return;
+	}
+	const double mb = (double)stats->size * kRepeatCount / (1024 * 1024);
+	info("  %-10s %4d entries %8d KB, reference %4d ms %6.1f MB/s, fast %4d ms %6.1f MB/s, %.1fx, %d errors",
+		stats->name, stats->entries, (int)(stats->size / 1024),
+		(int)(stats->referenceUs / 1000), mb * 1000000 / MAX(stats->referenceUs, (uint64_t)1),
+		(int)(stats->fastUs / 1000), mb * 1000000 / MAX(stats->fastUs, (uint64_t)1),
+		(double)stats->referenceUs / MAX(stats->fastUs, (uint64_t)1), stats->errors);
+}
+
+static void addStats(UnpackBenchStats *total, const UnpackBenchStats *stats) {
+	total->entries += stats->entries;
+	total->errors += stats->errors;
+	total->size += stats->size;
+	total->referenceUs += stats->referenceUs;
+	total->fastUs += stats->fastUs;
+}
+
+static uint8_t *loadFile(FileSystem *fs, Resource *res, const char *name, uint32_t *size) {
+	File f;
+	if (f.open(name, "rb", fs)) {
+		*size = f.size();
+		uint8_t *p = (uint8_t *)malloc(*size);
+		if (p) {
+			f.read(p, *size);
+		}
+		return p;
+	} else if (res->_archive && res->_archive->hasEntry(name)) {
+		return res->_archive->loadEntry(name, size);
+	}
+	return 0;
+}
+
+static void benchFile(UnpackBenchStats *stats, FileSystem *fs, Resource *res, const char *name, int offset) {
+	uint32_t size;
+	uint8_t *p = loadFile(fs, res, name, &size);
+	if (p) {
+		if (size >= (uint32_t)offset + 16) {
+			benchEntry(stats, name, p + offset, size - offset);
+		}
+		free(p);
+	}
+}
+
+bool benchUnpack(FileSystem *fs, ResourceType version) {
+	Resource *res = new Resource(fs, version, LANG_EN);
+	res->init();
+	UnpackBenchStats archive = { "ABA", 0, 0, 0, 0, 0 };
+	UnpackBenchStats levels = { "levels", 0, 0, 0, 0, 0 };
+	UnpackBenchStats banks = { "MBK banks", 0, 0, 0, 0, 0 };
+	if (res->_aba) {
+		ResourceAba *aba = res->_aba;
+		for (int i = 0; i < aba->_entriesCount; ++i) {
+			const ResourceAbaEntry *e = &aba->_entries[i];
+			if (e->compressedSize != e->size) {
+				File &f = aba->_f[e->fileIndex];
+				f.seek(e->offset);
+				uint8_t *buf;
+				const uint8_t *p = f.readData(e->compressedSize, &buf);
+				if (p) {
+					benchEntry(&archive, e->name, p, e->compressedSize);
+					free(buf);
+				}
+			}
+		}
+	}
+	if (version == kResourceTypeDOS || version == kResourceTypeAmiga) {
+		const char *prevName = 0;
+		for (int level = 0; level < 7; ++level) {
+			const char *name = (version == kResourceTypeAmiga) ? Game::_gameLevels[level].nameAmiga : Game::_gameLevels[level].name;
+			char entryName[32];
+			if (!prevName || strcmp(prevName, name) != 0) {
+				snprintf(entryName, sizeof(entryName), "%s.CT", name);
+				benchFile(&levels, fs, res, entryName, 0);
+				if (version == kResourceTypeDOS) {
+					snprintf(entryName, sizeof(entryName), "%s.MBK", name);
+					if (res->fileExists(entryName)) {
+						res->load(name, Resource::OT_MBK);
+						// the first byte is the number of banks
+						const int count = res->_mbk[0];
+						for (int num = 0; num < count; ++num) {
+							const uint8_t *ptr = res->_mbk + num * 6;
+							const int dataOffset = READ_BE_UINT32(ptr) & 0xFFFF;
+							if ((READ_BE_UINT16(ptr + 4) & 0x8000) == 0 && dataOffset > 4) {
+								snprintf(entryName, sizeof(entryName), "%s.MBK #%d", name, num);
+								benchEntry(&banks, entryName, res->_mbk + dataOffset, 0);
+							}
+						}
+						res->clearLevelRes();
+					}
+				}
+				prevName = name;
+			}
+			if (version == kResourceTypeAmiga) {
+				snprintf(entryName, sizeof(entryName), "%s.OBC", name);
+				// packed size in the first 4 bytes
+				benchFile(&levels, fs, res, entryName, 4);
+			}
+		}
+		if (version == kResourceTypeAmiga) {
+			benchFile(&levels, fs, res, "level1.SGD", 0);
+		}
+	}
+	delete res;
+	UnpackBenchStats total = { "total", 0, 0, 0, 0, 0 };
+	addStats(&total, &archive);
+	addStats(&total, &levels);
+	addStats(&total, &banks);
+	if (total.entries == 0) {
+		warning("No bytekiller compressed data found");
+		return false;
+	}
+	info("Bytekiller unpack, %d runs per entry:", kRepeatCount);
+	dumpStats(&archive);
+	dumpStats(&levels);
+	dumpStats(&banks);
+	dumpStats(&total);
+	return total.errors == 0;
+}
@@ -0,0 +1,17 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef UNPACK_BENCH_H__
+#define UNPACK_BENCH_H__
+
+#include "intern.h"
+
+struct FileSystem;
+
+// decodes the bytekiller compressed data with bytekiller_unpack and the reference decoder, checks and compares them
+extern bool benchUnpack(FileSystem *fs, ResourceType version);
+
+#endif // UNPACK_BENCH_H__
@@ -0,0 +1,188 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+#include <sys/param.h>
+#include <mutex>
+#include "file.h"
+#include "unpack_cache.h"
+#include "util.h"
+
+static const uint32_t TAG = 0x46425543; // 'FBUC'
+static const uint16_t kCacheVersion = 1;
+
+static const char *kNamePrefix = "rs-unpack-";
+
+// entries can be saved from the threads loading the level resources
+static std::mutex _sizeMutex;
+
+static void writeString(File &f, const char *s) {
+	const int len = strlen(s);
+	f.writeByte(len);
+	f.write(s, len);
+}
+
+static bool checkString(const uint8_t *&p, const uint8_t *end, const char *s) {
+	const int len = strlen(s);
+	if (end - p < 1 + len || p[0] != len || memcmp(p + 1, s, len) != 0) {
+		return false;
+	}
+	p += 1 + len;
+	return true;
+}
+
+void UnpackCache::makeKey(UnpackCacheKey *key, const char *archive, const char *name, const uint8_t *packedData, uint32_t packedSize, uint32_t size) {
+	key->archive = archive;
+	key->name = name;
+	key->packedSize = packedSize;
+	key->packedHash = hashData(packedData, packedSize);
+	key->size = size;
+}
+
+void UnpackCache::getName(char *name, int size, const UnpackCacheKey &key) const {
+	uint32_t hash = hashData((const uint8_t *)key.archive, strlen(key.archive), key.packedHash);
+	hash = hashData((const uint8_t *)key.name, strlen(key.name), hash);
+	hash = hashData((const uint8_t *)&key.packedSize, sizeof(key.packedSize), hash);
+	snprintf(name, size, "%s%08x.cache", kNamePrefix, hash);
+}
+
+uint8_t *UnpackCache::load(const UnpackCacheKey &key, uint32_t *size) {
+	if (!_directory || strlen(key.archive) > 255 || strlen(key.name) > 255) {
+		return 0;
+	}
+	char name[64];
+	getName(name, sizeof(name), key);
+	File f;
+	if (!f.open(name, "rb", _directory)) {
+		return 0;
+	}
+	// read back from the mapped file when possible
+	uint8_t *buf;
+	const uint32_t fileSize = f.size();
+	const uint8_t *p = f.readData(fileSize, &buf);
+	if (!p) {
+		return 0;
+	}
+	const uint8_t *end = p + fileSize;
+	uint8_t *data = 0;
+	if (fileSize >= 6 && READ_BE_UINT32(p) == TAG && READ_BE_UINT16(p + 4) == kCacheVersion) {
+		p += 6;
+		if (checkString(p, end, key.archive) && checkString(p, end, key.name) && end - p >= 16) {
+			const uint32_t dataSize = READ_BE_UINT32(p + 12);
+			if (READ_BE_UINT32(p) == key.packedSize && READ_BE_UINT32(p + 4) == key.packedHash && READ_BE_UINT32(p + 8) == key.size && (uint32_t)(end - p - 16) == dataSize) {
+				data = (uint8_t *)malloc(dataSize);
+				if (data) {
+					memcpy(data, p + 16, dataSize);
+					*size = dataSize;
+				}
+			}
+		}
+	}
+	free(buf);
+	if (!data) {
+		debug(DBG_RES, "Unpack cache '%s' does not match '%s' entry '%s'", name, key.archive, key.name);
+	}
+	return data;
+}
+
+void UnpackCache::save(const UnpackCacheKey &key, const uint8_t *data, uint32_t size) {
+	if (!_directory || strlen(key.archive) > 255 || strlen(key.name) > 255) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(_sizeMutex);
+		if (!_sizeScanned) {
+			scanDirectory();
+		}
+		if (_size + size > kMaxSize) {
+			debug(DBG_RES, "Unpack cache full, not saving '%s' entry '%s'", key.archive, key.name);
+			return;
+		}
+		// reserve the space, adjusted once the file is written
+		_size += size;
+	}
+	char name[64];
+	getName(name, sizeof(name), key);
+	char tmpName[sizeof(name) + 4];
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", name);
+	File f;
+	if (!f.open(tmpName, "wb", _directory)) {
+		warning("Unable to create unpack cache file '%s'", tmpName);
+		std::lock_guard<std::mutex> lock(_sizeMutex);
+		_size -= size;
+		return;
+	}
+	f.writeUint32BE(TAG);
+	f.writeUint16BE(kCacheVersion);
+	writeString(f, key.archive);
+	writeString(f, key.name);
+	f.writeUint32BE(key.packedSize);
+	f.writeUint32BE(key.packedHash);
+	f.writeUint32BE(key.size);
+	f.writeUint32BE(size);
+	f.write(data, size);
+	const bool ioErr = f.ioErr();
+	const uint32_t headerSize = f.tell() - size;
+	f.close();
+	char tmpPath[MAXPATHLEN];
+	snprintf(tmpPath, sizeof(tmpPath), "%s/%s", _directory, tmpName);
+	if (!ioErr) {
+		char path[MAXPATHLEN];
+		snprintf(path, sizeof(path), "%s/%s", _directory, name);
+		::remove(path);
+		if (rename(tmpPath, path) == 0) {
+			debug(DBG_RES, "Saved unpack cache '%s' for '%s' entry '%s'", name, key.archive, key.name);
+			std::lock_guard<std::mutex> lock(_sizeMutex);
+			_size += headerSize;
+			return;
+		}
+	}
+	warning("Unable to write unpack cache file '%s'", name);
+	::remove(tmpPath);
+	std::lock_guard<std::mutex> lock(_sizeMutex);
+	_size -= size;
+}
+
+void UnpackCache::scanDirectory() {
+	_sizeScanned = true;
+	_size = 0;
+#ifdef _WIN32
+	WIN32_FIND_DATA findData;
+	char searchPath[MAX_PATH];
+	snprintf(searchPath, sizeof(searchPath), "%s/%s*.cache", _directory, kNamePrefix);
+	HANDLE h = FindFirstFile(searchPath, &findData);
+	if (h != INVALID_HANDLE_VALUE) {
+		do {
+			_size += findData.nFileSizeLow;
+		} while (FindNextFile(h, &findData));
+		FindClose(h);
+	}
+#else
+	DIR *d = opendir(_directory);
+	if (d) {
+		const int prefixLen = strlen(kNamePrefix);
+		dirent *de;
+		while ((de = readdir(d)) != NULL) {
+			if (strncmp(de->d_name, kNamePrefix, prefixLen) == 0) {
+				char path[MAXPATHLEN];
+				snprintf(path, sizeof(path), "%s/%s", _directory, de->d_name);
+				struct stat st;
+				if (stat(path, &st) == 0) {
+					_size += st.st_size;
+				}
+			}
+		}
+		closedir(d);
+	}
+#endif
+	debug(DBG_RES, "Unpack cache size %d bytes", _size);
+}
@@ -0,0 +1,39 @@
+
+/*
+ * REminiscence - Flashback interpreter
+ * Copyright (C) 2005-2019 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef UNPACK_CACHE_H__
+#define UNPACK_CACHE_H__
+
+#include "intern.h"
+
+struct UnpackCacheKey {
+	const char *archive;
+	const char *name;
+	uint32_t packedSize, packedHash;
+	uint32_t size; // unpacked size in the archive, the cached data can be post-processed
+};
+
+// decompressed archive entries, stored in the save directory and named after the hash of the key.
+// Plain data, zero initialized with the Resource members.
+struct UnpackCache {
+	enum {
+		kMaxSize = 32 * 1024 * 1024 // total size of the cache files
+	};
+
+	const char *_directory;
+	uint32_t _size;
+	bool _sizeScanned;
+
+	static void makeKey(UnpackCacheKey *key, const char *archive, const char *name, const uint8_t *packedData, uint32_t packedSize, uint32_t size);
+
+	uint8_t *load(const UnpackCacheKey &key, uint32_t *size);
+	void save(const UnpackCacheKey &key, const uint8_t *data, uint32_t size);
+
+	void getName(char *name, int size, const UnpackCacheKey &key) const;
+	void scanDirectory();
+};
+
+#endif // UNPACK_CACHE_H__
@@ -75,3 +75,12 @@ void info(const char *msg, ...) {
 	__android_log_print(ANDROID_LOG_INFO, LOG_TAG, "%s", buf);
 #endif
 }
+
+uint32_t hashData(const uint8_t *data, uint32_t size, uint32_t hash) {
+	// FNV-1a
+	for (uint32_t i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
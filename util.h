@@ -35,6 +35,8 @@ extern void error(const char *msg, ...);
 extern void warning(const char *msg, ...);
 extern void info(const char *msg, ...);
 
+extern uint32_t hashData(const uint8_t *data, uint32_t size, uint32_t hash = 0x811C9DC5);
+
 #ifdef NDEBUG
 #define debug(x, ...)
 #endif
@@ -216,12 +216,11 @@ void Video::setPalette0xF() {
 }
 
 void Video::DOS_decodeLev(int level, int room) {
+	// the .BNQ banks are cached apart from the level banks, see Resource::getBankKey
 	uint8_t *tmp = _res->_mbk;
 	_res->_mbk = _res->_bnq;
-	_res->clearBankData();
 	AMIGA_decodeLev(level, room);
 	_res->_mbk = tmp;
-	_res->clearBankData();
 }
 
 static void DOS_decodeMapPlane(int sz, const uint8_t *src, uint8_t *dst) {